@@ -13,3 +13,12 @@ glslc -fshader-stage=compute shader/gradient_color.comp -o build/gradient_color.
 glslc -fshader-stage=vertex shader/triangle.vert -o build/triangle_vert.spv
 glslc -fshader-stage=fragment shader/triangle.frag -o build/triangle_frag.spv
 glslc -fshader-stage=vertex shader/triangle_mesh.vert -o build/triangle_mesh_vert.spv
+glslc -fshader-stage=fragment shader/mesh.frag -o build/mesh_frag.spv
+glslc -fshader-stage=compute shader/upscale.comp -o build/upscale.spv
+glslc -fshader-stage=compute shader/present.comp -o build/present.spv
+glslc -fshader-stage=compute shader/hzb.comp -o build/hzb.spv
+glslc -fshader-stage=compute shader/cull.comp -o build/cull.spv
+glslc -fshader-stage=compute shader/mipgen.comp -o build/mipgen.spv
+
+# all shaders are loaded from one pack next to executable
+build/shader_pack build/shaders.pack build/*.spv
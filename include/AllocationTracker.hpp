@@ -0,0 +1,67 @@
+//
+// allocation tracker
+//
+// instrumentation build, enabled by TK_ALLOCATION_TRACKING.
+// CPU allocations of global operator new and GPU device memory allocated by VMA
+// are attributed to innermost AllocationScope of the thread, others are counted as "other".
+// end_frame() reports counts and bytes of each scope allocated in this frame,
+// frames without allocations print nothing, so reports point to hitches.
+//
+// in other builds scopes are empty and nothing is tracked.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tk
+{
+
+#ifdef TK_ALLOCATION_TRACKING
+
+  class AllocationScope
+  {
+  public:
+    // name should be string literal
+    explicit AllocationScope(char const* name) noexcept;
+    ~AllocationScope();
+
+    AllocationScope(AllocationScope const&)            = delete;
+    AllocationScope& operator=(AllocationScope const&) = delete;
+
+  private:
+    uint32_t _parent;
+  };
+
+  namespace allocation_tracker
+  {
+    void on_cpu_allocate(size_t size)   noexcept;
+    void on_cpu_free(size_t size)       noexcept;
+    void on_gpu_allocate(uint64_t size) noexcept;
+    void on_gpu_free(uint64_t size)     noexcept;
+
+    // report allocations since last call
+    void end_frame(uint64_t frame);
+  }
+
+#else
+
+  class AllocationScope
+  {
+  public:
+    explicit AllocationScope(char const*) noexcept {}
+    ~AllocationScope() {}
+
+    AllocationScope(AllocationScope const&)            = delete;
+    AllocationScope& operator=(AllocationScope const&) = delete;
+  };
+
+  namespace allocation_tracker
+  {
+    inline void end_frame(uint64_t) {}
+  }
+
+#endif
+
+}
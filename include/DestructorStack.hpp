@@ -3,11 +3,15 @@
 //
 // use stack to save destructor objects
 //
+// destructors are stored inline, so pushing never allocates
+// except growing the stack itself.
+//
 
 #pragma once
 
-#include <stack>
-#include <functional>
+#include "InplaceFunction.hpp"
+
+#include <vector>
 
 namespace tk
 {
@@ -18,23 +22,25 @@ namespace tk
     DestructorStack()  = default;
     ~DestructorStack() = default;
 
-    DestructorStack(DestructorStack const&)            = default;
+    DestructorStack(DestructorStack const&)            = delete;
     DestructorStack(DestructorStack&&)                 = delete;
     DestructorStack& operator=(DestructorStack const&) = delete;
     DestructorStack& operator=(DestructorStack&&)      = delete;
 
-    void push(std::function<void()>&& func) { _destructors.push(func); }
+    void push(InplaceFunction<>&& func) { _destructors.emplace_back(std::move(func)); }
     void clear()
     {
+      // destructor may push others, so pop it before run
       while (!_destructors.empty())
       {
-        _destructors.top()();
-        _destructors.pop();
+        auto func = std::move(_destructors.back());
+        _destructors.pop_back();
+        func();
       }
     }
 
   private:
-    std::stack<std::function<void()>> _destructors;
+    std::vector<InplaceFunction<>> _destructors;
   };
 
 }
@@ -10,12 +10,15 @@
 #include <vk_mem_alloc.h>
 #include <glm/glm.hpp>
 
+#include <span>
+
 namespace tk { namespace graphics_engine {
 
   struct Buffer
   {
     VkBuffer          buffer          = VK_NULL_HANDLE;
     VmaAllocation     allocation      = VK_NULL_HANDLE;
+    VkDeviceSize      size            = 0;
 
     void destroy(VmaAllocator allocator) { vmaDestroyBuffer(allocator, buffer, allocation); }
   };
@@ -29,23 +32,55 @@ namespace tk { namespace graphics_engine {
     glm::vec4 color;
   };
 
+  // cluster of triangles for GPU culling, layout matches cull.comp
+  struct Meshlet
+  {
+    // bounding sphere, xyz is center, w is radius
+    glm::vec4 sphere;
+    // backface cone, xyz is axis, w is cutoff, never culled when cutoff bigger than 1
+    glm::vec4 cone;
+    // triangles are contiguous in mesh index buffer
+    uint32_t  start_index;
+    uint32_t  triangle_count;
+    uint32_t  padding[2];
+  };
+
   struct MeshBuffer
   {
     Buffer          vertices;
     Buffer          indices;
-    VkDeviceAddress address = {};
+    Buffer          meshlets;
+    VkDeviceAddress address         = {};
+    VkDeviceAddress index_address   = {};
+    VkDeviceAddress meshlet_address = {};
 
     void destroy(VmaAllocator allocator)
     {
       vertices.destroy(allocator);
       indices.destroy(allocator);
+      if (meshlets.buffer != VK_NULL_HANDLE)
+        meshlets.destroy(allocator);
     }
   };
 
+  // cpu side mesh data to upload
+  struct MeshData
+  {
+    std::span<Vertex const>   vertices;
+    std::span<uint32_t const> indices;
+    // optional, empty when meshlets are not built
+    std::span<Meshlet const>  meshlets;
+  };
+
   struct GeometryPushConstant
   {
-    glm::mat4       world_matrix;
-    VkDeviceAddress address = {};
+    // camera and object transforms in frame data buffer, instances index objects
+    VkDeviceAddress camera        = {};
+    VkDeviceAddress objects       = {};
+    VkDeviceAddress address       = {};
+    // bindless texture and its finest resident mip
+    uint32_t        texture_index = 0;
+    float           min_lod       = 0.f;
   };
 
 } }
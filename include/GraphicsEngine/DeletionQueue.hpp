@@ -0,0 +1,90 @@
+//
+// deletion queue
+//
+// destroy resources after GPU finished frames which may use them.
+// each resource is keyed by serial of a submitted frame, which is signaled to timeline semaphore,
+// it's destroyed once timeline reaches that serial.
+//
+// common handles are stored as typed records and destroyed in bulk,
+// other destructors are inline closures. records are kept in vectors whose capacity is reused,
+// so steady streaming never allocates. serials never decrease, so each vector is ordered,
+// and collecting stops at first record whose frame is still pending.
+//
+
+#pragma once
+
+#include "InplaceFunction.hpp"
+#include "Buffer.hpp"
+#include "Image.hpp"
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  class DeletionQueue
+  {
+  public:
+    // buffer and allocation, either may be null
+    void push(uint64_t serial, Buffer const& buffer)     { _buffers.emplace_back(serial, buffer); }
+    // image, its view and allocation
+    void push(uint64_t serial, Image const& image)       { _images.emplace_back(serial, image); }
+    void push(uint64_t serial, VkImageView view)         { _image_views.emplace_back(serial, view); }
+    void push(uint64_t serial, InplaceFunction<>&& func) { _funcs.emplace_back(serial, std::move(func)); }
+
+    // destroy resources of finished frames, views first, then images, buffers and closures
+    void collect(uint64_t completed_serial, VkDevice device, VmaAllocator allocator)
+    {
+      collect(_image_views, completed_serial, [&](auto view)           { vkDestroyImageView(device, view, nullptr); });
+      collect(_images,      completed_serial, [&](auto const& image)   { vkDestroyImageView(device, image.view, nullptr);
+                                                                          vmaDestroyImage(allocator, image.image, image.allocation); });
+      collect(_buffers,     completed_serial, [&](auto const& buffer)  { vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation); });
+
+      // closure may push others, so they're moved out before run
+      auto end   = std::ranges::find_if(_funcs, [&](auto const& record) { return record.serial > completed_serial; });
+      auto count = size_t(end - _funcs.begin());
+      for (size_t i = 0; i < count; ++i)
+      {
+        auto func = std::move(_funcs[i].resource);
+        func();
+      }
+      _funcs.erase(_funcs.begin(), _funcs.begin() + count);
+    }
+
+    // only call it after device idle
+    void flush(VkDevice device, VmaAllocator allocator)
+    {
+      while (!empty())
+        collect(UINT64_MAX, device, allocator);
+    }
+
+    auto empty() const noexcept { return _buffers.empty() && _images.empty() && _image_views.empty() && _funcs.empty(); }
+
+  private:
+    template <typename T>
+    struct Record
+    {
+      uint64_t serial;
+      T        resource;
+    };
+
+    template <typename T, typename Destroy>
+    static void collect(std::vector<Record<T>>& records, uint64_t completed_serial, Destroy&& destroy)
+    {
+      auto end = std::ranges::find_if(records, [&](auto const& record) { return record.serial > completed_serial; });
+      for (auto it = records.begin(); it != end; ++it)
+        destroy(it->resource);
+      records.erase(records.begin(), end);
+    }
+
+    std::vector<Record<Buffer>>            _buffers;
+    std::vector<Record<Image>>             _images;
+    std::vector<Record<VkImageView>>       _image_views;
+    std::vector<Record<InplaceFunction<>>> _funcs;
+  };
+
+} }
@@ -0,0 +1,49 @@
+//
+// descriptor allocator
+//
+// allocate descriptor sets from chained pools, a new pool is created when all are full,
+// and each new pool is bigger than last one. sets are never freed one by one,
+// reset() resets whole pools at once, so it fits sets used by one frame.
+//
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <span>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  class DescriptorAllocator
+  {
+  public:
+    // descriptors of a type per set in a pool
+    struct PoolRatio
+    {
+      VkDescriptorType type;
+      float            ratio;
+    };
+
+    void init(VkDevice device, uint32_t sets_per_pool, std::span<PoolRatio const> ratios);
+    void destroy();
+
+    auto allocate(VkDescriptorSetLayout layout) -> VkDescriptorSet;
+
+    // all sets allocated before are invalid, only call it when GPU doesn't use them
+    void reset();
+
+  private:
+    auto get_pool() -> VkDescriptorPool;
+    auto create_pool(uint32_t set_count) -> VkDescriptorPool;
+
+    static constexpr uint32_t Max_Sets_Per_Pool = 4096;
+
+    VkDevice                      _device        = VK_NULL_HANDLE;
+    std::vector<PoolRatio>        _ratios;
+    std::vector<VkDescriptorPool> _full_pools;
+    std::vector<VkDescriptorPool> _ready_pools;
+    uint32_t                      _sets_per_pool = 0;
+  };
+
+} }
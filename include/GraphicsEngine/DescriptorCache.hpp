@@ -0,0 +1,84 @@
+//
+// descriptor cache
+//
+// immutable descriptor sets keyed by layout and contents of bindings,
+// same contents share one set which is written once.
+//
+// when a resource of sets is destroyed, evict() removes them from cache,
+// and they should be recycled after frames using them finished,
+// recycled sets are reused for same layout instead of freeing.
+//
+
+#pragma once
+
+#include "DescriptorAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  class DescriptorCache
+  {
+  public:
+    // a descriptor, image or buffer is used by type
+    struct Binding
+    {
+      uint32_t               binding;
+      VkDescriptorType       type;
+      VkDescriptorImageInfo  image  = {};
+      VkDescriptorBufferInfo buffer = {};
+
+      bool operator==(Binding const& other) const noexcept;
+      // image view, sampler or buffer is used
+      bool uses(uint64_t handle) const noexcept;
+    };
+
+    void init(VkDevice device, std::span<DescriptorAllocator::PoolRatio const> ratios);
+    void destroy();
+
+    auto get(VkDescriptorSetLayout layout, std::span<Binding const> bindings) -> VkDescriptorSet;
+
+    // retire(layout, set) is called for each evicted set
+    template <typename Handle, typename Retire>
+    void evict(Handle handle, Retire&& retire)
+    {
+      std::erase_if(_sets, [&](auto const& entry)
+      {
+        for (auto const& binding : entry.first.bindings)
+          if (binding.uses((uint64_t)handle))
+          {
+            retire(entry.first.layout, entry.second);
+            return true;
+          }
+        return false;
+      });
+    }
+
+    void recycle(VkDescriptorSetLayout layout, VkDescriptorSet set) { _free_sets[layout].emplace_back(set); }
+
+  private:
+    struct Key
+    {
+      VkDescriptorSetLayout layout;
+      std::vector<Binding>  bindings;
+
+      bool operator==(Key const&) const = default;
+    };
+
+    struct KeyHash
+    {
+      auto operator()(Key const& key) const noexcept -> size_t;
+    };
+
+    VkDevice                                                                _device = VK_NULL_HANDLE;
+    DescriptorAllocator                                                     _allocator;
+    std::unordered_map<Key, VkDescriptorSet, KeyHash>                       _sets;
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> _free_sets;
+  };
+
+} }
@@ -6,20 +6,92 @@
 
 #pragma once
 
-#include "DestructorStack.hpp"
+#include "Buffer.hpp"
+#include "LinearAllocator.hpp"
+#include "DescriptorAllocator.hpp"
+#include "ErrorHandling.hpp"
 
 #include <vulkan/vulkan.h>
 
+#include <cstddef>
+#include <cstring>
+#include <span>
+
 namespace tk { namespace graphics_engine {
 
+  //
+  // persistently mapped host coherent buffer, device local when BAR is available.
+  // per frame data like camera and transforms are copied by CPU and read by shaders via device address,
+  // so they aren't limited by size of push constant.
+  // reset after frame's fence waited, data of frames in flight are in other frames' buffers.
+  // buffer without device address, e.g. stage buffer, returns offset of pushed values instead.
+  //
+  struct FrameDataBuffer
+  {
+    // default alignment of buffer reference
+    static constexpr uint32_t Alignment = 16;
+
+    Buffer          buffer;
+    std::byte*      data    = nullptr;
+    VkDeviceAddress address = {};
+    VkDeviceSize    offset  = 0;
+
+    // copy values and return device address of first one
+    template <typename T>
+    auto push(std::span<T const> values) -> VkDeviceAddress
+    {
+      auto begin = aligned_size(offset);
+      throw_if(begin + values.size_bytes() > buffer.size, "frame data buffer overflow: {} bytes", begin + values.size_bytes());
+      std::memcpy(data + begin, values.data(), values.size_bytes());
+      offset = begin + values.size_bytes();
+      return address + begin;
+    }
+
+    template <typename T>
+    auto push(T const& value) -> VkDeviceAddress { return push(std::span<T const>(&value, 1)); }
+
+    // size taken by a push
+    static auto aligned_size(VkDeviceSize size) noexcept { return (size + Alignment - 1) / Alignment * Alignment; }
+
+    void reset() noexcept { offset = 0; }
+  };
+
   struct FrameResource
   {
     VkCommandBuffer command_buffer      = VK_NULL_HANDLE;
     VkFence         fence               = VK_NULL_HANDLE;
     VkSemaphore     image_available_sem = VK_NULL_HANDLE; 
     VkSemaphore     render_finished_sem = VK_NULL_HANDLE; 
+    // with swapchain maintenance, signaled when present of this frame is finished
+    VkFence         present_fence       = VK_NULL_HANDLE;
+    // present known finished once present fence, or fence of this frame without it, is signaled
+    uint32_t        present_id          = 0;
+
+    // pools of sets used by this frame only, reset after fence waited
+    DescriptorAllocator descriptors;
+
+    // allocated and written every frame
+    VkDescriptorSet present_set         = VK_NULL_HANDLE;
+
+    // hzb build and meshlet cull, allocated and written every frame
+    VkDescriptorSet hzb_set             = VK_NULL_HANDLE;
+
+    // output of meshlet cull pass, compacted indices and indirect draw command
+    Buffer          cull_indices;
+    Buffer          cull_draw;
+    bool            culled              = false;
+
+    // camera, object transforms and cull data of this frame
+    FrameDataBuffer frame_data;
+
+    // texels of texture uploads of this frame, in system memory
+    FrameDataBuffer texture_stage;
+
+    // GPU timestamps of begin and end of frame are written
+    bool            has_timestamps      = false;
 
-    DestructorStack destructors;
+    // transient CPU data of recording, e.g. draw lists and barriers, reset after fence waited
+    LinearAllocator arena               { 64 * 1024 };
   };
 
 } }
@@ -3,9 +3,8 @@
 //
 // use Vulkan to implement
 //
-// TODO:
-// 1. use offscreen rendering, but when window size bigger than image size, it will be stretch,
-//    maybe need to recreate image in this case.
+// use offscreen rendering, images are created with screen size,
+// only recreate them when window size bigger than image size.
 //
 
 #pragma once
@@ -13,15 +12,25 @@
 #include "Window.hpp"
 #include "FrameResource.hpp"
 #include "DestructorStack.hpp"
+#include "DeletionQueue.hpp"
+#include "DescriptorCache.hpp"
+#include "PipelineRegistry.hpp"
 #include "Image.hpp"
 #include "Buffer.hpp"
 #include "gltf.hpp"
+#include "MeshRegistry.hpp"
+#include "Residency.hpp"
+#include "LatencyTracker.hpp"
+#include "ResolutionController.hpp"
 
 #include <vk_mem_alloc.h>
 #include <SDL3/SDL_events.h>
 
 #include <vector>
 #include <span>
+#include <future>
+#include <unordered_map>
+#include <utility>
 
 namespace tk { namespace graphics_engine {
 
@@ -50,12 +59,61 @@ namespace tk { namespace graphics_engine {
 
     // HACK: 32bit indices? not 16bit?
     auto create_mesh_buffer(std::span<Vertex> vertices, std::span<uint32_t> indices) -> MeshBuffer;
+    // upload meshes by one stage buffer and one submit
+    auto create_mesh_buffers(std::span<MeshData const> meshs) -> std::vector<MeshBuffer>;
+    // destroyed after frames which may use it finished
+    void destroy_mesh_buffer(MeshBuffer const& mesh_buffer);
+    // let defragmentation patch handles and addresses of mesh buffer when it's moved,
+    // mesh buffer must stay at same place until destroyed
+    void register_mesh_buffer(MeshBuffer& mesh_buffer);
+
+    // decode png on worker thread, texture is streamed in after decoded
+    auto load_texture(std::filesystem::path const& path) -> std::shared_ptr<Texture>;
+    // stream decoded image in, coarse mips first, same images are shared
+    auto create_texture(ImageData&& data) -> std::shared_ptr<Texture>;
+
+    // meshs and textures tracked against memory budget
+    auto residency() noexcept -> Residency& { return _residency; }
 
   private:
     void draw_background(VkCommandBuffer cmd);
     void draw_geometry(VkCommandBuffer cmd);
+    void cull_meshlets(FrameResource& frame);
+    void build_hzb(FrameResource& frame);
+    void update_hzb_set(FrameResource& frame);
+    void update_camera();
+    // screen pixels of a mesh space unit at nearest point of bounds, used to select lod
+    auto get_pixels_per_unit(MeshAsset const& mesh, glm::mat4 const& world) const -> float;
+    void draw_present(VkCommandBuffer cmd, uint32_t image_index);
+    void poll_present_timing();
+    void update_draw_extent(FrameResource const& frame);
+    // take finished decodes and create images of new textures, it allocates so it's out of hot path
+    void poll_textures();
+    // upload decoded textures under budget and generate their mips
+    void stream_textures(FrameResource& frame);
+    void generate_mips(VkCommandBuffer cmd, Texture const& texture, uint32_t begin, uint32_t end);
+    // bindless index and min lod, default texture when not resident
+    auto get_texture_binding(Texture const* texture) const -> std::pair<uint32_t, float>;
+    // evict assets when over memory budget, and record copies of demoted textures
+    void update_residency(FrameResource& frame);
+    void demote_texture(FrameResource& frame, Texture& texture);
+    // throw when source doesn't match demoted image
+    void promote_texture(FrameResource& frame, Texture& texture, ImageData&& data);
+    // move geometry out of sparse memory blocks, one pass at a time, and end pass after its frame finished
+    void defragment_geometry(FrameResource& frame);
+    void end_defragment_pass();
+    void end_defragmentation();
 
     uint32_t _pipeline_index = 0;
+    // use compute pass instead of blit to write draw image to swapchain,
+    // it upscales when draw extent smaller than swapchain, and can fuse tonemap, gamma and dither.
+    bool     _compute_present  = true;
+    bool     _tonemap_enabled  = false;
+    // cull meshlets on GPU and draw indirectly, occlusion uses depth of last frame
+    bool     _meshlet_culling   = true;
+    bool     _occlusion_culling = true;
+    float    _sharpness        = .25f;
+    uint32_t _frame_count      = 0;
 
   private:
     //
@@ -67,18 +125,36 @@ namespace tk { namespace graphics_engine {
     void select_physical_device();
     void create_device_and_get_queues();
     void create_vma_allocator();
+    void create_geometry_pool();
     void create_swapchain_and_rendering_image();
     void create_swapchain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
+    void create_rendering_image(VkExtent2D extent);
     void create_descriptor_set_layout();
+    void create_pipeline_registry();
     void create_compute_pipeline();
     void create_graphics_pipeline();
+    void create_present_pipelines();
+    void create_cull_pipelines();
+    void create_cull_buffers();
+    // index and draw command counts of cull buffers for meshs with meshlets
+    auto get_cull_counts() const -> std::pair<uint32_t, uint32_t>;
+    static auto get_cull_index_count(MeshAsset const& mesh) -> uint32_t;
+    void reserve_cull_buffers(FrameResource& frame, uint32_t index_count, uint32_t draw_count);
+    void create_texture_resources();
+    void create_default_texture();
     void create_command_pool();
-    void create_descriptor_pool();
+    void create_descriptor_allocators();
     void create_descriptor_sets();
     void create_sync_objects();
     void create_frame_resources();
+    void create_frame_data_buffers();
+    void create_query_pool();
 
     void resize_swapchain();
+    // destroy retired swapchains whose presents are finished
+    void on_present_finished(uint32_t present_id);
+    // wait all frames in flight and destroy their retired resources
+    void wait_frames_finished();
 
     void upload_data();
 
@@ -94,13 +170,35 @@ namespace tk { namespace graphics_engine {
                        uint32_t size, VkBufferUsageFlags usage,
                        void const* data = nullptr);
 
-    auto create_buffer(uint32_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flag = 0) -> Buffer;
+    auto create_buffer(uint32_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flag = 0, VmaPool pool = VK_NULL_HANDLE) -> Buffer;
+    // release retained assets and wait released memory freed, allocation is tried again after it
+    void reclaim_memory();
+    auto get_buffer_address(VkBuffer buffer) const -> VkDeviceAddress;
+    auto allocate_texture() -> std::shared_ptr<Texture>;
+    void create_texture_image(Texture& texture, uint32_t width, uint32_t height);
+    void destroy_texture(Texture* texture);
 
     static void transition_image_layout(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout);
+    // transition multiple images in one barrier, barriers are allocated from arena
+    struct ImageLayoutTransition
+    {
+      VkImage       image;
+      VkImageLayout old_layout;
+      VkImageLayout new_layout;
+    };
+    static void transition_image_layouts(VkCommandBuffer cmd, std::span<ImageLayoutTransition const> transitions,
+                                         std::pmr::memory_resource* arena);
+    static auto get_image_layout_barrier(ImageLayoutTransition const& transition) -> VkImageMemoryBarrier2;
+    // global memory barrier, for buffers written and read by different stages
+    static void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
+                                                    VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access);
     static auto get_image_subresource_range(VkImageAspectFlags aspect) -> VkImageSubresourceRange;
     static void copy_image(VkCommandBuffer cmd, VkImage src, VkImage dst, VkExtent2D src_extent, VkExtent2D dst_extent);
+    void destroy_image(Image const& image);
 
     void load_gltf();
+    // upload meshs of async loads, draw meshs of load_gltf() once they're ready
+    void poll_meshs();
 
   private:
     //
@@ -117,22 +215,85 @@ namespace tk { namespace graphics_engine {
     VkQueue                      _graphics_queue           = VK_NULL_HANDLE;
     VkQueue                      _present_queue            = VK_NULL_HANDLE;
 
+    // optional device extensions
+    bool                         _display_timing_supported = false;
+    bool                         _storage_write_without_format = false;
+    bool                         _memory_budget_supported  = false;
+    bool                         _dynamic_blend_supported  = false;
+    bool                         _surface_maintenance_supported   = false;
+    bool                         _swapchain_maintenance_supported = false;
+    PFN_vkGetPastPresentationTimingGOOGLE _vkGetPastPresentationTimingGOOGLE = nullptr;
+
     // use dynamic rendering
     VkSwapchainKHR               _swapchain                = VK_NULL_HANDLE;
     std::vector<VkImage>         _swapchain_images;
     VkExtent2D                   _swapchain_image_extent   = {};
+    VkFormat                     _swapchain_format         = VK_FORMAT_UNDEFINED;
+    // swapchain images can be written by compute shader directly,
+    // otherwise present pass writes to _present_image and copy it to swapchain image.
+    bool                         _swapchain_storage        = false;
+    std::vector<VkImageView>     _swapchain_image_views;
+    // old swapchains are destroyed after presents to them finished
+    struct RetiredSwapchain
+    {
+      VkSwapchainKHR swapchain;
+      uint32_t       last_present_id;
+    };
+    std::vector<RetiredSwapchain> _retired_swapchains;
+    // last present of each swapchain image
+    std::vector<uint32_t>        _swapchain_present_ids;
+    uint32_t                     _finished_present_id      = 0;
+    Image                        _present_image            = {};
     Image                        _image                    = {};
     Image                        _depth_image              = {};
+    // hierarchical depth buffer, mip 0 is half of depth image,
+    // rebuilt every frame from draw extent and used by next frame's cull pass.
+    Image                        _hzb                      = {};
+    std::vector<VkImageView>     _hzb_mip_views;
+    uint32_t                     _hzb_mip_count            = 0;
+    VkSampler                    _hzb_sampler              = VK_NULL_HANDLE;
+    bool                         _hzb_valid                = false;
+    VkExtent2D                   _hzb_extent               = {};
+    uint32_t                     _hzb_level_count          = 0;
+    glm::mat4                    _hzb_view_proj            = {};
+    // camera of current frame
+    glm::mat4                    _view                     = {};
+    glm::mat4                    _proj                     = {};
     VkExtent2D                   _draw_extent              = {};
 
     std::vector<VkPipeline>      _compute_pipeline;
+    // workgroup size of background pipelines
+    VkExtent2D                   _background_group_size    = {};
     std::vector<VkPipelineLayout>_compute_pipeline_layout;
     VkPipeline                   _graphics_pipeline        = VK_NULL_HANDLE;
     VkPipelineLayout             _graphics_pipeline_layout = VK_NULL_HANDLE;
+    // graphics and background pipelines are owned by registry
+    PipelineRegistry             _pipelines;
     VkPipeline                   _mesh_pipeline            = VK_NULL_HANDLE;
+    // dynamic states of mesh pipeline are recorded from its key
+    PipelineKey                  _mesh_pipeline_key;
     VkPipelineLayout             _mesh_pipeline_layout     = VK_NULL_HANDLE;
+    VkPipeline                   _upscale_pipeline         = VK_NULL_HANDLE;
+    VkPipeline                   _present_pipeline         = VK_NULL_HANDLE;
+    VkPipelineLayout             _present_pipeline_layout  = VK_NULL_HANDLE;
+    VkPipeline                   _hzb_pipeline             = VK_NULL_HANDLE;
+    VkPipelineLayout             _hzb_pipeline_layout      = VK_NULL_HANDLE;
+    VkPipeline                   _cull_pipeline            = VK_NULL_HANDLE;
+    VkPipelineLayout             _cull_pipeline_layout     = VK_NULL_HANDLE;
     MeshBuffer                   _mesh_buffer;
 
+    // mesh buffers are allocated from geometry pool, it's defragmented by passes,
+    // moved buffers are copied by pass's frame, and old places are freed after it finished
+    VmaPool                        _geometry_pool          = VK_NULL_HANDLE;
+    VmaDefragmentationContext      _defrag_context         = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo _defrag_pass            = {};
+    // serial of frame copying current pass, 0 when no pass
+    uint64_t                       _defrag_serial          = 0;
+    // destroyed after pass ended, allocations can't be freed while they're moving
+    std::vector<MeshBuffer>        _defrag_released;
+    // pool statistics when last defragmentation ended, only restart after pool changed
+    VmaStatistics                  _defrag_last_stats      = {};
+
     VkCommandPool                _command_pool             = VK_NULL_HANDLE;
 
     //
@@ -141,16 +302,71 @@ namespace tk { namespace graphics_engine {
     std::vector<FrameResource>   _frames;
     uint32_t                     _current_frame            = 0;
     auto get_current_frame() -> FrameResource& { return _frames[_current_frame]; }
+
+    //
+    // deferred destruction
+    //
+    // every submit signals its serial to timeline semaphore.
+    // released resources may be used by submitted frames and the recording one,
+    // so they're destroyed after next submit finished, without waiting device idle.
+    // resource is a buffer, image, image view or small closure.
+    //
+    void defer_destroy(auto&& resource) { _deletion_queue.push(_submitted_serial + 1, std::forward<decltype(resource)>(resource)); }
+    // destroy resources of finished frames, returns serial of last finished frame
+    auto collect_garbage() -> uint64_t;
+    VkSemaphore                  _frame_timeline           = VK_NULL_HANDLE;
+    uint64_t                     _submitted_serial         = 0;
+    DeletionQueue                _deletion_queue;
     
     DestructorStack              _destructors;
 
-    VkDescriptorPool             _descriptor_pool          = VK_NULL_HANDLE;
+    // GPU timestamps, two queries per frame
+    VkQueryPool                  _query_pool               = VK_NULL_HANDLE;
+    float                        _timestamp_period         = 0.f;
+    uint64_t                     _timestamp_mask           = 0;
+
+    // dynamic resolution
+    ResolutionController         _resolution;
+
+    // immutable sets, per frame sets are allocated from frame resource
+    DescriptorCache              _descriptor_cache;
     VkDescriptorSetLayout        _descriptor_set_layout    = VK_NULL_HANDLE;
     VkDescriptorSet              _descriptor_set           = VK_NULL_HANDLE;
+    VkDescriptorSetLayout        _present_set_layout       = VK_NULL_HANDLE;
+    VkDescriptorSetLayout        _hzb_set_layout           = VK_NULL_HANDLE;
+
+    // bindless textures, index is reused after frames sampling it finished
+    struct TextureDecode
+    {
+      std::weak_ptr<Texture>     texture;
+      std::future<ImageData>     data;
+    };
+    VkDescriptorSetLayout        _texture_set_layout       = VK_NULL_HANDLE;
+    VkDescriptorPool             _texture_pool             = VK_NULL_HANDLE;
+    VkDescriptorSet              _texture_set              = VK_NULL_HANDLE;
+    VkSampler                    _texture_sampler          = VK_NULL_HANDLE;
+    VkDescriptorSetLayout        _mipgen_set_layout        = VK_NULL_HANDLE;
+    VkPipelineLayout             _mipgen_pipeline_layout   = VK_NULL_HANDLE;
+    VkPipeline                   _mipgen_pipeline          = VK_NULL_HANDLE;
+    std::vector<uint32_t>        _free_texture_indices;
+    std::shared_ptr<Texture>     _default_texture;
+    std::unordered_map<uint64_t, std::weak_ptr<Texture>> _textures;
+    std::vector<TextureDecode>   _texture_decodes;
+    // demoted textures loading from source, and loaded ones waiting for promotion
+    std::vector<TextureDecode>   _texture_promotions;
+    std::vector<std::pair<std::shared_ptr<Texture>, ImageData>> _promoted_textures;
+    std::vector<std::weak_ptr<Texture>> _streaming_textures;
 
     // mesh
-    std::vector<std::shared_ptr<MeshAsset>> _meshs;
+    MeshRegistry                 _mesh_registry            { this };
+    MeshHandles                  _meshs;
+    std::shared_ptr<MeshRequest> _mesh_request;
+    Residency                    _residency;
     int x = 0, y = 0, z = 0;
+
+    // input-to-photon latency
+    LatencyTracker               _latency;
+    uint32_t                     _present_id               = 0;
   };
 
 } }
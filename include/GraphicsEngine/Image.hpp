@@ -4,6 +4,8 @@
 // image struct
 //
 
+#pragma once
+
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 
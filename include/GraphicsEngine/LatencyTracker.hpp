@@ -0,0 +1,94 @@
+//
+// latency tracker
+//
+// measure input-to-photon latency of key down events.
+// the oldest unhandled input is latched by update() and carried through
+// record, submit and present of the frame, when VK_GOOGLE_display_timing
+// is supported also to the actual present time reported by driver.
+// latencies are accumulated in histograms and reported periodically.
+//
+// all timestamps are steady clock nanoseconds, which is CLOCK_MONOTONIC on linux,
+// the same clock used by VK_GOOGLE_display_timing.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace tk { namespace graphics_engine {
+
+  class LatencyHistogram
+  {
+  public:
+    void add(uint64_t ns);
+    void report(std::string_view name) const;
+    void clear();
+    auto count() const noexcept { return _count; }
+
+  private:
+    // upper bound of each bucket in microseconds, last bucket is unbounded
+    static constexpr std::array<uint64_t, 12> Bucket_Bounds
+    {
+      1000, 2000, 4000, 8000, 12000, 16000, 20000, 25000, 33000, 50000, 66000, 100000,
+    };
+
+    auto percentile(float p) const -> uint64_t;
+
+    std::array<uint32_t, Bucket_Bounds.size() + 1> _buckets = {};
+    uint32_t                                       _count   = 0;
+    uint64_t                                       _sum     = 0;
+    uint64_t                                       _max     = 0;
+  };
+
+  struct LatencySample
+  {
+    uint64_t input      = 0;
+    uint64_t update     = 0;
+    uint64_t record     = 0;
+    uint64_t submit     = 0;
+    uint64_t present    = 0;
+    uint32_t present_id = 0;
+  };
+
+  class LatencyTracker
+  {
+  public:
+    static auto now() -> uint64_t;
+
+    // key down event
+    void on_input(uint64_t timestamp);
+
+    // frame stages, only record when a input is latched
+    void on_update();
+    void on_record();
+    void on_submit();
+    void on_present(uint32_t present_id, bool wait_display_time);
+
+    // actual present time from VK_GOOGLE_display_timing
+    void on_display(uint32_t present_id, uint64_t display_time);
+
+    // report histograms every Report_Interval
+    void end_frame();
+
+  private:
+    static constexpr uint64_t Report_Interval     = 5'000'000'000;
+    static constexpr uint32_t Max_Pending_Display = 8;
+
+    void finish(LatencySample const& sample);
+
+    uint64_t                                         _pending_input  = 0;
+    bool                                             _latched        = false;
+    LatencySample                                    _current;
+    std::array<LatencySample, Max_Pending_Display>   _wait_display;
+    uint32_t                                         _wait_display_index = 0;
+    uint64_t                                         _last_report    = 0;
+
+    LatencyHistogram                                 _input_to_update;
+    LatencyHistogram                                 _input_to_submit;
+    LatencyHistogram                                 _input_to_present;
+    LatencyHistogram                                 _input_to_display;
+  };
+
+} }
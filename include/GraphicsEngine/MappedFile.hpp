@@ -0,0 +1,38 @@
+//
+// mapped file
+//
+// read only memory mapped file, unmapped when destroyed.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace tk { namespace graphics_engine {
+
+  class MappedFile
+  {
+  public:
+    MappedFile() = default;
+    // throw when file can't be opened or mapped
+    MappedFile(std::filesystem::path const& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile const&)            = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    auto data() const noexcept { return std::span<std::byte const>(_data, _size); }
+    auto size() const noexcept { return _size; }
+
+  private:
+    void unmap() noexcept;
+
+    std::byte const* _data = nullptr;
+    size_t           _size = 0;
+  };
+
+} }
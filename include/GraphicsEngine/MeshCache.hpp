@@ -0,0 +1,65 @@
+//
+// mesh cache
+//
+// cooked mesh format (.tkmesh), stores final vertices, indices, meshlets, surfaces and bounds,
+// so meshs can be copied from mapped file to stage buffer directly without parsing.
+//
+// layout:
+//   header | mesh entries | names | surfaces | vertices, indices and meshlets (16 bytes aligned)
+//
+// cache is keyed by content hash of source file and format version,
+// stale cache is treated as missing and rewritten.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+#include "MappedFile.hpp"
+
+#include <optional>
+
+namespace tk { namespace graphics_engine {
+
+  struct CookedMesh
+  {
+    std::string                  name;
+    std::vector<GeometrySurface> surfaces;
+    Bounds                       bounds;
+    MeshData                     data;
+    // hash of data and surfaces, identical meshs of different files are shared,
+    // check is an independent hash to tell meshs of same content hash apart
+    uint64_t                     content_hash  = 0;
+    uint64_t                     content_check = 0;
+  };
+
+  // cooked meshs and storages they point to, which is either mapped cache file or parsed data
+  struct CookedGltf
+  {
+    MappedFile                         cache_file;
+    std::vector<std::vector<Vertex>>   vertices;
+    std::vector<std::vector<uint32_t>> indices;
+    std::vector<std::vector<Meshlet>>  meshlets;
+    std::vector<CookedMesh>            meshs;
+    // decoded images of file, only when surfaces reference them
+    std::vector<ImageData>             images;
+  };
+
+  auto hash_bytes(std::span<std::byte const> bytes, uint64_t hash = 0xcbf29ce484222325) -> uint64_t;
+  // independent of hash_bytes, collisions of both are not correlated
+  auto check_hash_bytes(std::span<std::byte const> bytes, uint64_t hash = 0x9e3779b97f4a7c15) -> uint64_t;
+  auto hash_file(std::filesystem::path const& path) -> uint64_t;
+
+  // read cache or parse gltf and write cache, no GPU work so it can run on any thread
+  auto cook_gltf(std::filesystem::path const& path, uint64_t source_hash, bool build_meshlets) -> CookedGltf;
+
+  // decode one image of gltf, used when demoted texture is loaded again
+  auto load_gltf_image(std::filesystem::path const& path, uint32_t index) -> ImageData;
+
+  // return nullopt when cache is missing, stale or broken.
+  // mesh data points into file, so file should be alive until data is uploaded.
+  auto read_mesh_cache(std::filesystem::path const& path, uint64_t source_hash, MappedFile& file) -> std::optional<std::vector<CookedMesh>>;
+
+  // write to temporary file then rename it, so a broken cache never be read
+  void write_mesh_cache(std::filesystem::path const& path, uint64_t source_hash, std::span<CookedMesh const> meshs);
+
+} }
@@ -0,0 +1,40 @@
+//
+// mesh optimizer
+//
+// reorder meshs at import time to reduce vertex shader work:
+//   weld:         merge duplicated vertices so they are shaded once.
+//   vertex cache: Tipsify (Sander et al. 2007), reorder triangles for post transform cache.
+//   overdraw:     sort Tipsify clusters so likely occluders are drawn first.
+//   vertex fetch: reorder vertices by first use for linear memory access.
+//
+// indices of each surface are only reordered in its range, so surfaces are kept.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+
+#include <span>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  // size of simulated FIFO post transform cache
+  inline constexpr uint32_t Vertex_Cache_Size = 16;
+
+  void weld_vertices(std::vector<Vertex>& vertices, std::span<uint32_t> indices);
+
+  // return triangle offsets where Tipsify start new clusters, first is always 0
+  auto optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count) -> std::vector<uint32_t>;
+
+  void optimize_overdraw(std::span<uint32_t> indices, std::span<Vertex const> vertices, std::span<uint32_t const> clusters);
+
+  void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::span<uint32_t> indices);
+
+  // average cache miss per triangle
+  auto analyze_vertex_cache(std::span<uint32_t const> indices, uint32_t vertex_count) -> float;
+
+  // run all passes
+  void optimize_mesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::span<GeometrySurface const> surfaces);
+
+} }
@@ -0,0 +1,101 @@
+//
+// mesh registry
+//
+// share loaded meshs instead of uploading duplicates.
+// files are keyed by path and content hash of source, so a changed file is loaded again.
+// meshs are keyed by content hash of cooked data, so identical meshs of different files
+// are uploaded once. a second independent hash is compared before sharing a mesh.
+//
+// registry only keeps weak references, GPU buffers are destroyed by deferred destruction
+// of engine when last handle is dropped. handles must be dropped before engine destroyed.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+#include "MeshCache.hpp"
+
+#include <future>
+#include <optional>
+#include <unordered_map>
+
+namespace tk { namespace graphics_engine {
+
+  using MeshHandles = std::vector<std::shared_ptr<MeshAsset>>;
+
+  struct MeshRequest
+  {
+    enum class Status
+    {
+      Loading,
+      Ready,
+      Failed,
+    };
+
+    std::filesystem::path path;
+    Status                status = Status::Loading;
+    // valid when ready
+    MeshHandles           meshs;
+  };
+
+  class MeshRegistry
+  {
+  public:
+    MeshRegistry(class GraphicsEngine* engine) : _engine(engine) {}
+
+    // blocking load, meshs of same file are returned when they are still alive.
+    // meshlets are needed by GPU culling, they're optional for small meshs.
+    auto load(std::filesystem::path const& path, bool build_meshlets = true) -> MeshHandles;
+
+    // hash and cook on worker thread, upload by poll() on render thread.
+    // requests of same file are merged, alive meshs of unchanged file are returned without upload.
+    auto load_async(std::filesystem::path const& path, bool build_meshlets = true) -> std::shared_ptr<MeshRequest>;
+
+    // upload finished async requests, call once per frame on render thread
+    void poll();
+
+    // wait async requests and forget all entries, handles outside are still valid
+    void clear();
+
+  private:
+    struct FileEntry
+    {
+      uint64_t                              source_hash    = 0;
+      bool                                  build_meshlets = false;
+      std::vector<std::weak_ptr<MeshAsset>> meshs;
+    };
+
+    // content check of mesh is kept to compare meshs of same content hash
+    struct MeshEntry
+    {
+      std::weak_ptr<MeshAsset> mesh;
+      uint64_t                 content_check = 0;
+    };
+
+    struct CookResult
+    {
+      uint64_t   source_hash = 0;
+      CookedGltf cooked;
+    };
+
+    struct PendingRequest
+    {
+      std::string                  key;
+      bool                         build_meshlets = false;
+      std::shared_ptr<MeshRequest> request;
+      std::future<CookResult>      result;
+    };
+
+    auto find_file(std::string const& key, uint64_t source_hash, bool build_meshlets) -> std::optional<MeshHandles>;
+    // upload meshs not alive in registry by one batch
+    auto upload(CookedGltf& cooked) -> MeshHandles;
+    void add_file(std::string const& key, uint64_t source_hash, bool build_meshlets, MeshHandles const& meshs);
+    void prune();
+
+    class GraphicsEngine*                                   _engine;
+    std::unordered_map<std::string, FileEntry>              _files;
+    std::unordered_map<uint64_t, MeshEntry>                 _meshs;
+    std::vector<PendingRequest>                             _pending;
+  };
+
+} }
@@ -0,0 +1,28 @@
+//
+// mesh simplifier
+//
+// generate lod chain by edge collapse with quadric error metrics (Garland and Heckbert 1997).
+// collapse is done on positions, so vertices only differ in attributes (seams) move together,
+// collapsed vertex takes the attributes of the target position whose normal is closest.
+// vertices are never created or moved, lods only append indices to the mesh index buffer.
+// border vertices are locked to avoid holes.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+
+#include <span>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  // simplify indices to target triangle count, return simplified indices and
+  // store max collapse error as distance in mesh space.
+  // stop earlier when no more valid collapse.
+  auto simplify(std::span<Vertex const> vertices, std::span<uint32_t const> indices, uint32_t target_triangle_count, float& error) -> std::vector<uint32_t>;
+
+  // each lod halves triangles of previous one, lods which can't reduce enough are dropped
+  void generate_lods(std::span<Vertex const> vertices, std::vector<uint32_t>& indices, std::span<GeometrySurface> surfaces);
+
+} }
@@ -0,0 +1,30 @@
+//
+// meshlet builder
+//
+// split triangles into meshlets of at most Meshlet_Max_Vertices unique vertices
+// and Meshlet_Max_Triangles triangles, in index order, so triangles of a meshlet
+// stay contiguous in index buffer and keep the vertex cache order.
+// each meshlet has bounding sphere and normal cone for GPU culling.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+
+#include <span>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  inline constexpr uint32_t Meshlet_Max_Vertices  = 64;
+  inline constexpr uint32_t Meshlet_Max_Triangles = 124;
+
+  // indices is the whole mesh index buffer, only [start_index, start_index + count) is split
+  void build_meshlets(std::span<Vertex const> vertices, std::span<uint32_t const> indices,
+                      uint32_t start_index, uint32_t count, std::vector<Meshlet>& meshlets);
+
+  // build meshlets of all lods of surfaces
+  void build_meshlets(std::span<Vertex const> vertices, std::span<uint32_t const> indices,
+                      std::span<GeometrySurface> surfaces, std::vector<Meshlet>& meshlets);
+
+} }
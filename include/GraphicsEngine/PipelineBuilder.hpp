@@ -1,22 +1,86 @@
 //
-// pipeline builder 
+// pipeline builder
 //
-// config pipeline then create it 
+// config pipeline then create it
 // use dynamic rendering so don't need framebuffer and render pass
 //
+// all config is kept in a pipeline key, so same config can be found in pipeline registry,
+// and pipeline can be created from key later on other thread.
+//
+// cull and depth config can be dynamic (core 1.3), blend config can be dynamic
+// with VK_EXT_extended_dynamic_state3, then they are set by commands when drawing,
+// and keys only different in them share one base pipeline.
+//
+// compute pipeline is created when compute shader is set, other config is ignored.
+// specialization constants are shared by all stages, so workgroup size or
+// kernel variant can be chosen when creating pipeline.
+//
 // TODO:
-//  1. currently only graphics pipeline, after extend to compute pipeline
-//  2. try multiple create pipelines at once
-//  3. use VK_EXT_extended_dynamic_state3 to make more config become dynamic config
+//  1. try multiple create pipelines at once
 //
 
 #pragma once
 
 #include <vulkan/vulkan.h>
 
-#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace tk { namespace graphics_engine {
+
+  // value of constant_id in shader, only 32bit constants
+  struct SpecializationConstant
+  {
+    uint32_t id    = 0;
+    uint32_t value = 0;
+
+    bool operator==(SpecializationConstant const&) const = default;
+  };
+
+  // full state of a pipeline, plain values so it can be compared and hashed
+  struct PipelineKey
+  {
+    static constexpr uint32_t Max_Constants = 8;
 
-namespace tk { namespace graphics_engine { 
+    VkPipelineLayout      layout              = VK_NULL_HANDLE;
+    VkShaderModule        vertex_shader       = VK_NULL_HANDLE;
+    VkShaderModule        fragment_shader     = VK_NULL_HANDLE;
+    VkShaderModule        compute_shader      = VK_NULL_HANDLE;
+    std::array<SpecializationConstant, Max_Constants> constants = {};
+    uint32_t              constant_count      = 0;
+    VkFormat              color_format        = VK_FORMAT_UNDEFINED;
+    VkFormat              depth_format        = VK_FORMAT_UNDEFINED;
+    VkCullModeFlags       cull_mode           = VK_CULL_MODE_NONE;
+    VkFrontFace           front_face          = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkBool32              depth_test          = VK_FALSE;
+    VkBool32              depth_write         = VK_FALSE;
+    VkCompareOp           depth_compare       = VK_COMPARE_OP_NEVER;
+    VkBool32              blend_enable        = VK_FALSE;
+    VkBlendFactor         src_color_factor    = VK_BLEND_FACTOR_ZERO;
+    VkBlendFactor         dst_color_factor    = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp             color_blend_op      = VK_BLEND_OP_ADD;
+    VkBlendFactor         src_alpha_factor    = VK_BLEND_FACTOR_ZERO;
+    VkBlendFactor         dst_alpha_factor    = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp             alpha_blend_op      = VK_BLEND_OP_ADD;
+    VkColorComponentFlags color_write_mask    = VK_COLOR_COMPONENT_R_BIT |
+                                                VK_COLOR_COMPONENT_G_BIT |
+                                                VK_COLOR_COMPONENT_B_BIT |
+                                                VK_COLOR_COMPONENT_A_BIT;
+    // states are set by commands instead of baked in pipeline
+    VkBool32              dynamic_depth_cull  = VK_FALSE;
+    VkBool32              dynamic_blend       = VK_FALSE;
+
+    // key of pipeline actually created, dynamic states are reset to default
+    auto get_base() const -> PipelineKey;
+
+    bool operator==(PipelineKey const&) const = default;
+
+    struct Hash
+    {
+      auto operator()(PipelineKey const& key) const noexcept -> size_t;
+    };
+  };
 
   class PipelineBuilder
   {
@@ -31,32 +95,30 @@ namespace tk { namespace graphics_engine {
 
     // TODO: when use dynamic rendering, can make return type is a class which can use in rendering process
     auto build(VkDevice device, VkPipelineLayout layout)                           -> VkPipeline;
+    // key of current config, get pipeline of it from pipeline registry
+    auto get_key(VkPipelineLayout layout) const                                    -> PipelineKey;
     auto clear()                                                                   -> PipelineBuilder&;
 
+    // thread safe, only read key
+    static auto build(VkDevice device, PipelineKey const& key, VkPipelineCache cache = VK_NULL_HANDLE) -> VkPipeline;
+
     // TODO: expand to multiple attachments
     auto set_color_attachment_format(VkFormat format)                              -> PipelineBuilder&;
-    // TODO: expand for compute shader
-    //       and default use "main" as enter point of shader
+    // default use "main" as enter point of shader
     auto set_shaders(VkShaderModule vertex_shader, VkShaderModule fragment_shader) -> PipelineBuilder&;
+    auto set_compute_shader(VkShaderModule shader)                                 -> PipelineBuilder&;
+    auto set_constant(uint32_t id, uint32_t value)                                 -> PipelineBuilder&;
     // HACK: should be discard because of dynamic rendering, see spec
     auto set_cull_mode(VkCullModeFlags cull_mode, VkFrontFace front_face)          -> PipelineBuilder&;
     auto enable_depth_test(VkFormat format)                                        -> PipelineBuilder&;
     auto enable_additive_blending()                                                -> PipelineBuilder&;
     auto enable_alpha_blending()                                                   -> PipelineBuilder&;
+    auto enable_dynamic_depth_cull()                                               -> PipelineBuilder&;
+    // only use it when VK_EXT_extended_dynamic_state3 blend features are supported
+    auto enable_dynamic_blend()                                                    -> PipelineBuilder&;
 
   private:
-    std::vector<VkPipelineShaderStageCreateInfo> _shader_stages;
-    VkPipelineRenderingCreateInfo                _rendering_info        { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO            };
-    VkPipelineRasterizationStateCreateInfo       _rasterization_state   { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO  };
-    VkPipelineDepthStencilStateCreateInfo        _depth_stencil_state   { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-    VkFormat                                     _rendering_info_format { VK_FORMAT_UNDEFINED };
-    VkPipelineColorBlendAttachmentState          _color_blend_attachment
-    {
-      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-                        VK_COLOR_COMPONENT_G_BIT |
-                        VK_COLOR_COMPONENT_B_BIT |
-                        VK_COLOR_COMPONENT_A_BIT,
-    };
+    PipelineKey _key;
  };
 
 } }
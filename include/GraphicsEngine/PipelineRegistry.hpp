@@ -0,0 +1,75 @@
+//
+// pipeline registry
+//
+// pipelines are keyed by full config of pipeline builder,
+// same config returns existing pipeline instead of creating again.
+//
+// build() creates pipelines needed by first frame. get() creates new configs on other thread
+// and returns fallback pipeline until it is ready or when it failed, so first use doesn't stall frame.
+//
+// shader modules are owned by registry, they must live while pipelines are compiling,
+// they are created from shader pack which is mapped until registry destroyed.
+// all pipelines share one VkPipelineCache.
+//
+// keys only different in dynamic states share one base pipeline, set_dynamic_state()
+// records them after binding. dynamic blend falls back to baked pipelines per blend
+// config when device doesn't support VK_EXT_extended_dynamic_state3.
+//
+
+#pragma once
+
+#include "PipelineBuilder.hpp"
+#include "ShaderPack.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <future>
+#include <string>
+#include <unordered_map>
+
+namespace tk { namespace graphics_engine {
+
+  class PipelineRegistry
+  {
+  public:
+    void init(VkDevice device, std::filesystem::path const& shader_pack, bool dynamic_blend_supported);
+    // wait compiling pipelines, then destroy all pipelines and shaders
+    void destroy();
+
+    // shader module of shader in pack, only create once
+    auto get_shader(std::string const& name) -> VkShaderModule;
+
+    // create pipeline now if not exist
+    auto build(PipelineKey const& key) -> VkPipeline;
+    // return fallback if pipeline is not ready, and start compiling it on first call
+    auto get(PipelineKey const& key, VkPipeline fallback) -> VkPipeline;
+
+    // record dynamic states of key, call it after binding pipeline of key
+    void set_dynamic_state(VkCommandBuffer cmd, PipelineKey const& key) const;
+
+  private:
+    // key of pipeline actually created
+    auto get_base(PipelineKey key) const -> PipelineKey;
+
+    struct Entry
+    {
+      VkPipeline              pipeline = VK_NULL_HANDLE;
+      std::future<VkPipeline> pending;
+    };
+
+    // take compiled pipeline of worker, never throw
+    static void take_pending(Entry& entry);
+
+    VkDevice                                                   _device = VK_NULL_HANDLE;
+    VkPipelineCache                                            _cache  = VK_NULL_HANDLE;
+    ShaderPack                                                 _shader_pack;
+    std::unordered_map<PipelineKey, Entry, PipelineKey::Hash>  _pipelines;
+    std::unordered_map<std::string, VkShaderModule>            _shaders;
+
+    bool                                                       _dynamic_blend_supported        = false;
+    PFN_vkCmdSetColorBlendEnableEXT                            _vkCmdSetColorBlendEnableEXT    = nullptr;
+    PFN_vkCmdSetColorBlendEquationEXT                          _vkCmdSetColorBlendEquationEXT  = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT                              _vkCmdSetColorWriteMaskEXT      = nullptr;
+  };
+
+} }
@@ -0,0 +1,64 @@
+//
+// residency
+//
+// keep device memory under budget of each heap, which is reported by VK_EXT_memory_budget.
+// meshs and textures are stamped when drawn, when usage of a heap is over high watermark,
+// least recently used assets are released until it's estimated under low watermark:
+//   1. meshs only kept by residency, they're retained after released by user,
+//      so loading them again is free while memory is enough.
+//   2. cold textures are demoted by dropping their top mip,
+//      they're loaded from source and promoted when drawn again.
+//
+// assets drawn by frames in flight are never cold, so demoted textures can rewrite
+// their bindless slot without waiting GPU.
+//
+
+#pragma once
+
+#include "gltf.hpp"
+#include "Texture.hpp"
+
+#include <vk_mem_alloc.h>
+
+#include <memory>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  // fraction of heap budget which starts and stops eviction
+  inline constexpr float    Residency_High_Watermark = .9f;
+  inline constexpr float    Residency_Low_Watermark  = .8f;
+  // frames an asset isn't drawn before it can be demoted, must be more than frames in flight
+  inline constexpr uint32_t Residency_Cold_Frames    = 120;
+
+  class Residency
+  {
+  public:
+    // mesh is retained until evicted
+    void track(std::shared_ptr<MeshAsset> const& mesh);
+    void track(std::shared_ptr<Texture> const& texture);
+
+    // stamp asset used by current frame
+    void touch(MeshAsset& mesh)    noexcept { mesh.last_used    = _frame; }
+    void touch(Texture&   texture) noexcept { texture.last_used = _frame; }
+
+    // advance frame and evict least recently used meshs of heaps over budget,
+    // returns textures to demote, caller records their copies
+    auto update(VmaAllocator allocator) -> std::vector<std::shared_ptr<Texture>>;
+
+    // demoted textures drawn again, each is returned once
+    auto take_promotions() -> std::vector<std::shared_ptr<Texture>>;
+
+    // release all meshs not used by user, when allocation failed, returns count of them
+    auto release_retained() -> uint32_t;
+
+    void clear();
+
+  private:
+    uint64_t                                _frame        = 0;
+    uint64_t                                _cooldown_end = 0;
+    std::vector<std::shared_ptr<MeshAsset>> _meshs;
+    std::vector<std::weak_ptr<Texture>>     _textures;
+  };
+
+} }
@@ -0,0 +1,52 @@
+//
+// resolution controller
+//
+// dynamic resolution, scale draw extent by measured GPU frame time.
+// use hysteresis to avoid oscillation:
+//   over budget for a few frames, decrease scale quickly.
+//   under budget for many frames, increase scale slowly.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace tk { namespace graphics_engine {
+
+  class ResolutionController
+  {
+  public:
+    ResolutionController()  = default;
+    ~ResolutionController() = default;
+
+    ResolutionController(ResolutionController const&)            = delete;
+    ResolutionController(ResolutionController&&)                 = delete;
+    ResolutionController& operator=(ResolutionController const&) = delete;
+    ResolutionController& operator=(ResolutionController&&)      = delete;
+
+    // feed GPU time of a finished frame in milliseconds
+    void update(float gpu_ms);
+
+    auto scale() const noexcept { return _scale; }
+
+    // default target 60Hz and keep some headroom for CPU submit and present
+    void set_budget(float ms) noexcept { _budget = ms; }
+    void set_min_scale(float scale) noexcept { _min_scale = scale; }
+
+  private:
+    static constexpr float    Decrease_Threshold = .95f;
+    static constexpr float    Increase_Threshold = .75f;
+    static constexpr uint32_t Frames_To_Decrease = 3;
+    static constexpr uint32_t Frames_To_Increase = 60;
+    static constexpr float    Increase_Step      = .05f;
+    static constexpr float    Smooth_Factor      = .1f;
+
+    float    _budget        = 14.f;
+    float    _min_scale     = .5f;
+    float    _scale         = 1.f;
+    float    _smoothed_ms   = 0.f;
+    uint32_t _over_frames   = 0;
+    uint32_t _under_frames  = 0;
+  };
+
+} }
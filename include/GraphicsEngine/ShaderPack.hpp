@@ -0,0 +1,42 @@
+//
+// shader pack
+//
+// all SPIR-V modules in one file (.pack), built by shader_pack tool after shaders compiled,
+// mapped once at startup and modules are created from mapped memory without copy.
+//
+// layout:
+//   header | entries (name and range of module) | modules (16 bytes aligned)
+//
+// shader is named by stem of its spv file, e.g. build/hzb.spv is "hzb".
+//
+
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+
+namespace tk { namespace graphics_engine {
+
+  class ShaderPack
+  {
+  public:
+    ShaderPack() = default;
+    // throw when file is missing, broken or of other version
+    ShaderPack(std::filesystem::path const& path);
+
+    // code points into mapped file, throw when shader not in pack
+    auto get(std::string_view name) const -> std::span<uint32_t const>;
+
+  private:
+    MappedFile _file;
+    uint32_t   _shader_count = 0;
+  };
+
+  // write to temporary file then rename it, so a broken pack never be read
+  void write_shader_pack(std::filesystem::path const& path, std::span<std::filesystem::path const> spv_files);
+
+} }
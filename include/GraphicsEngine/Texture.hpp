@@ -0,0 +1,95 @@
+//
+// texture
+//
+// images are decoded to rgba8 on worker threads, then streamed by render thread
+// under a per frame upload budget, coarse mips first:
+//   1. a small preview is box filtered on worker thread, it is uploaded to tail mip,
+//      and mips under it are generated by compute, so texture is usable at once.
+//   2. full resolution mip is uploaded by rows in later frames.
+//   3. mips between full resolution and tail are generated by compute.
+// shader clamps sampled lod to finest resident mip.
+//
+// demoted texture is loaded from its source again when it's sampled, texels stream
+// to a new full size image, and mips of demoted image are copied under top mip.
+//
+// all mips are kept in general layout, so uploading fine mips never blocks sampling coarse ones.
+//
+
+#pragma once
+
+#include "Image.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+  // size of bindless texture array, same as shader/mesh.frag
+  inline constexpr uint32_t Max_Texture_Count      = 1024;
+  // max texels of width and height of preview
+  inline constexpr uint32_t Texture_Preview_Size   = 64;
+  // bytes of texels uploaded per frame
+  inline constexpr uint32_t Texture_Upload_Budget  = 4 * 1024 * 1024;
+  // bytes of previews uploaded per frame, new textures over it wait for next frame
+  inline constexpr uint32_t Texture_Preview_Budget = 1024 * 1024;
+  // persistent stage buffer of each frame holds both
+  inline constexpr uint32_t Texture_Stage_Size     = Texture_Upload_Budget + Texture_Preview_Budget;
+
+  // where texels are loaded from, so demoted texture can be loaded again
+  struct ImageSource
+  {
+    std::filesystem::path path;
+    // index of image embedded in gltf, ~0u when path is an image file
+    uint32_t              gltf_image = ~0u;
+
+    auto empty() const noexcept { return path.empty(); }
+  };
+
+  // rgba8 texels in sRGB
+  struct ImageData
+  {
+    uint32_t               width   = 0;
+    uint32_t               height  = 0;
+    std::vector<std::byte> texels;
+    // preview of tail mip, empty when image itself is small enough
+    uint32_t               tail_mip = 0;
+    std::vector<std::byte> preview;
+    // hash of encoded bytes, same images are shared
+    uint64_t               hash     = 0;
+    // kept after texels released, empty when texels are not from a file
+    ImageSource            source;
+
+    auto empty() const noexcept { return texels.empty(); }
+  };
+
+  // only png is supported, throw when failed
+  auto decode_image(std::span<std::byte const> bytes) -> ImageData;
+  auto load_image(std::filesystem::path const& path) -> ImageData;
+
+  struct Texture
+  {
+    // index of bindless texture array
+    uint32_t                 index         = 0;
+    Image                    image;
+    // storage views of each mip for mip generation
+    std::vector<VkImageView> mip_views;
+    uint32_t                 mip_count     = 0;
+    // finest mip which can be sampled, ~0u when nothing is uploaded
+    uint32_t                 resident_mip  = ~0u;
+
+    // streaming state, texels are released after full resolution uploaded
+    ImageData                data;
+    uint32_t                 uploaded_rows = 0;
+
+    // frame of residency last sampled
+    uint64_t                 last_used     = 0;
+    // top mips are dropped by residency, loaded from source again when sampled
+    bool                     demoted       = false;
+
+    auto resident() const noexcept { return resident_mip < mip_count; }
+  };
+
+} }
@@ -1,11 +1,17 @@
 //
 // use fastgltf to load gltf
 //
+// the first load of a file writes a cooked .tkmesh next to it,
+// later loads map the cooked file instead of parsing gltf.
+// files are loaded and shared through MeshRegistry.
+//
 
 #pragma once
 
 #include "Buffer.hpp"
+#include "Texture.hpp"
 
+#include <array>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -13,19 +19,59 @@
 
 namespace tk { namespace graphics_engine {
 
+  inline constexpr uint32_t Max_Lod_Count = 4;
+  // surface without base color image
+  inline constexpr uint32_t No_Image      = ~0u;
+
+  struct SurfaceLod
+  {
+    uint32_t start_index    = 0;
+    uint32_t count          = 0;
+    // max geometric deviation from full detail in mesh space
+    float    error          = 0.f;
+    // meshlets of this lod, they cover same indices as above
+    uint32_t meshlet_offset = 0;
+    uint32_t meshlet_count  = 0;
+  };
+
+  // keep trivially copyable, it is stored in mesh cache as is
   struct GeometrySurface
   {
-    uint32_t start_index = 0;
-    uint32_t count       = 0;
+    uint32_t                              start_index = 0;
+    uint32_t                              count       = 0;
+    // lods[0] is the full detail range above, coarser lods follow
+    uint32_t                              lod_count   = 1;
+    std::array<SurfaceLod, Max_Lod_Count> lods        = {};
+    // glTF image of base color texture, index of MeshAsset::textures
+    uint32_t                              image       = No_Image;
+
+    // coarsest lod whose error projected to screen is under max_error_pixels
+    auto select_lod(float pixels_per_unit, float max_error_pixels) const -> SurfaceLod const&
+    {
+      uint32_t i = 0;
+      while (i + 1 < lod_count && lods[i + 1].error * pixels_per_unit <= max_error_pixels)
+        ++i;
+      return lods[i];
+    }
+  };
+
+  // axis aligned bounding box in mesh space
+  struct Bounds
+  {
+    glm::vec3 min = {};
+    glm::vec3 max = {};
   };
 
   struct MeshAsset
   {
     std::string                  name;
     std::vector<GeometrySurface> surfaces;
+    Bounds                       bounds;
     MeshBuffer                   mesh_buffer; 
+    // textures of file's images, null when image is missing or not decodable
+    std::vector<std::shared_ptr<Texture>> textures;
+    // frame of residency last drawn
+    uint64_t                     last_used = 0;
   };
 
-  auto load_gltf(class GraphicsEngine* engine, std::filesystem::path file_path) -> std::vector<std::shared_ptr<MeshAsset>>;
-
 } }
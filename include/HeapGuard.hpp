@@ -0,0 +1,56 @@
+//
+// heap guard
+//
+// check of hot paths, enabled by TK_HEAP_GUARD in debug build.
+// global operator new is replaced to count allocations of each thread.
+// NoHeapScope asserts nothing allocated from heap while it alive,
+// AllowHeapScope exempts one-off events inside it, e.g. resizing and reclaiming memory.
+//
+// only C++ allocations are counted, malloc of C libraries and drivers is not.
+// in other builds nothing is counted and scopes are empty.
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <exception>
+
+namespace tk
+{
+
+  // allocations of this thread out of AllowHeapScope
+  auto heap_allocation_count() noexcept -> uint64_t;
+
+  class NoHeapScope
+  {
+  public:
+    NoHeapScope() noexcept
+      : _count(heap_allocation_count()), _exceptions(std::uncaught_exceptions()) {}
+
+    ~NoHeapScope()
+    {
+      // message of thrown error may allocate
+      assert((std::uncaught_exceptions() > _exceptions || heap_allocation_count() == _count) &&
+             "heap allocated in no heap scope");
+    }
+
+    NoHeapScope(NoHeapScope const&)            = delete;
+    NoHeapScope& operator=(NoHeapScope const&) = delete;
+
+  private:
+    uint64_t _count;
+    int      _exceptions;
+  };
+
+  class AllowHeapScope
+  {
+  public:
+    AllowHeapScope() noexcept;
+    ~AllowHeapScope();
+
+    AllowHeapScope(AllowHeapScope const&)            = delete;
+    AllowHeapScope& operator=(AllowHeapScope const&) = delete;
+  };
+
+}
@@ -0,0 +1,84 @@
+//
+// inplace function
+//
+// move only void() callable stored in fixed inline buffer, never allocates.
+// closure bigger than buffer fails to compile, capture handles instead of containers.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tk
+{
+
+  template <size_t Size = 48>
+  class InplaceFunction
+  {
+  public:
+    InplaceFunction() = default;
+
+    template <typename Func>
+      requires (!std::is_same_v<std::decay_t<Func>, InplaceFunction> && std::is_invocable_v<std::decay_t<Func>&>)
+    InplaceFunction(Func&& func)
+    {
+      using T = std::decay_t<Func>;
+      static_assert(sizeof(T)  <= Size,                         "closure is too big for inplace function");
+      static_assert(alignof(T) <= alignof(std::max_align_t),    "closure is over aligned for inplace function");
+      static_assert(std::is_nothrow_move_constructible_v<T>,    "closure must be nothrow movable");
+
+      new (_storage) T(std::forward<Func>(func));
+      _invoke = [](void* self) { (*static_cast<T*>(self))(); };
+      // move to dst when it isn't null, then destroy src
+      _manage = [](void* dst, void* src) noexcept
+      {
+        if (dst)
+          new (dst) T(std::move(*static_cast<T*>(src)));
+        static_cast<T*>(src)->~T();
+      };
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept { move_from(other); }
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        move_from(other);
+      }
+      return *this;
+    }
+    InplaceFunction(InplaceFunction const&)            = delete;
+    InplaceFunction& operator=(InplaceFunction const&) = delete;
+
+    ~InplaceFunction() { reset(); }
+
+    void operator()() { _invoke(_storage); }
+    explicit operator bool() const noexcept { return _invoke != nullptr; }
+
+    void reset() noexcept
+    {
+      if (_manage)
+        _manage(nullptr, _storage);
+      _invoke = nullptr;
+      _manage = nullptr;
+    }
+
+  private:
+    void move_from(InplaceFunction& other) noexcept
+    {
+      if (other._manage)
+        other._manage(_storage, other._storage);
+      _invoke = std::exchange(other._invoke, nullptr);
+      _manage = std::exchange(other._manage, nullptr);
+    }
+
+    alignas(std::max_align_t) std::byte _storage[Size];
+    void (*_invoke)(void*)                 = nullptr;
+    void (*_manage)(void*, void*) noexcept = nullptr;
+  };
+
+}
@@ -0,0 +1,114 @@
+//
+// linear allocator
+//
+// bump allocator over one buffer allocated at construction, deallocation does nothing,
+// all memory is released by reset(). used as std::pmr memory resource for transient data,
+// e.g. per frame allocator which is reset after frame's fence signaled.
+//
+// when buffer is exhausted, blocks are taken from upstream and freed by next reset,
+// increase capacity when overflow count isn't zero.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+namespace tk
+{
+
+  class LinearAllocator : public std::pmr::memory_resource
+  {
+  public:
+    explicit LinearAllocator(size_t capacity, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+      : _buffer(std::make_unique<std::byte[]>(capacity)), _capacity(capacity), _upstream(upstream) {}
+
+    ~LinearAllocator() { release_overflows(); }
+
+    LinearAllocator(LinearAllocator&& other) noexcept
+      : _buffer(std::move(other._buffer)), _capacity(other._capacity), _offset(other._offset),
+        _high_water(other._high_water), _overflow_count(other._overflow_count),
+        _overflows(std::exchange(other._overflows, nullptr)), _upstream(other._upstream) {}
+    LinearAllocator(LinearAllocator const&)            = delete;
+    LinearAllocator& operator=(LinearAllocator const&) = delete;
+    LinearAllocator& operator=(LinearAllocator&&)      = delete;
+
+    // all memory allocated before is invalid
+    void reset() noexcept
+    {
+      release_overflows();
+      _offset         = 0;
+      _overflow_count = 0;
+    }
+
+    auto capacity()       const noexcept { return _capacity;       }
+    auto used()           const noexcept { return _offset;         }
+    // max used bytes since constructed
+    auto high_water()     const noexcept { return _high_water;     }
+    // allocations from upstream since last reset
+    auto overflow_count() const noexcept { return _overflow_count; }
+
+  private:
+    // header of upstream block, they are chained to free by reset
+    struct Overflow
+    {
+      Overflow* next;
+      size_t    size;
+      size_t    alignment;
+    };
+
+    static auto get_header_size(size_t alignment) noexcept
+    {
+      return (sizeof(Overflow) + alignment - 1) / alignment * alignment;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+      auto base   = reinterpret_cast<uintptr_t>(_buffer.get());
+      auto offset = (base + _offset + alignment - 1) / alignment * alignment - base;
+      if (offset + bytes <= _capacity)
+      {
+        _offset     = offset + bytes;
+        _high_water = std::max(_high_water, _offset);
+        return _buffer.get() + offset;
+      }
+
+      alignment   = std::max(alignment, alignof(Overflow));
+      auto header = get_header_size(alignment);
+      auto block  = static_cast<std::byte*>(_upstream->allocate(header + bytes, alignment));
+      _overflows  = new (block) Overflow{ _overflows, header + bytes, alignment };
+      ++_overflow_count;
+      return block + header;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+    {
+      return this == &other;
+    }
+
+    void release_overflows() noexcept
+    {
+      while (_overflows)
+      {
+        auto overflow = _overflows;
+        _overflows    = overflow->next;
+        _upstream->deallocate(overflow, overflow->size, overflow->alignment);
+      }
+    }
+
+    std::unique_ptr<std::byte[]> _buffer;
+    size_t                       _capacity       = 0;
+    size_t                       _offset         = 0;
+    size_t                       _high_water     = 0;
+    uint32_t                     _overflow_count = 0;
+    Overflow*                    _overflows      = nullptr;
+    std::pmr::memory_resource*   _upstream       = nullptr;
+  };
+
+}
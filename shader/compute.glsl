@@ -1,6 +1,7 @@
 #version 460
 
-layout (local_size_x = 16, local_size_y = 16) in;
+// workgroup size is chosen by device when creating pipeline
+layout (local_size_x_id = 0, local_size_y_id = 1) in;
 
 layout (rgba16f, set = 0, binding = 0) uniform image2D image;
 
@@ -13,7 +14,8 @@ void main()
   {
     vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
 
-    if (gl_LocalInvocationID.x != 0 && gl_LocalInvocationID.y != 0)
+    // grid of 16 pixels, independent of workgroup size
+    if (texel_coord.x % 16 != 0 && texel_coord.y % 16 != 0)
     {
       color.x = float(texel_coord.x) / size.x;
       color.y = float(texel_coord.y) / size.y;
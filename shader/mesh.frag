@@ -0,0 +1,30 @@
+#version 460
+
+//
+// mesh fragment shader
+//
+// vertex color is modulated by bindless base color texture.
+// sampled lod is clamped to finest resident mip, finer mips may be still streaming.
+//
+
+layout (location = 0) in  vec3 in_color;
+layout (location = 1) in  vec2 in_uv;
+layout (location = 0) out vec4 out_color;
+
+// same as Max_Texture_Count
+const uint Max_Texture_Count = 1024;
+
+layout (set = 0, binding = 0) uniform sampler2D textures[Max_Texture_Count];
+
+// after camera, objects and vertex buffer addresses of vertex shader
+layout (push_constant) uniform PushConstant
+{
+  layout (offset = 24) uint  texture_index;
+                       float min_lod;
+} push_constant;
+
+void main()
+{
+  float lod = max(textureQueryLod(textures[push_constant.texture_index], in_uv).y, push_constant.min_lod);
+  out_color = vec4(in_color, 1.f) * textureLod(textures[push_constant.texture_index], in_uv, lod);
+}
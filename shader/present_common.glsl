@@ -0,0 +1,65 @@
+//
+// common part of present passes, which write draw image to swapchain image
+//
+// output transform converts HDR linear color to display:
+//   tonemap: ACES filmic approximation
+//   gamma:   sRGB encode, only when swapchain format is UNORM
+//   dither:  triangular noise of 1 LSB to hide 8bit banding
+//
+
+layout (rgba16f, set = 0, binding = 0) readonly  uniform image2D input_image;
+layout (         set = 0, binding = 1) writeonly uniform image2D output_image;
+
+layout (push_constant) uniform constants
+{
+  ivec2 input_size;
+  ivec2 output_size;
+  float sharpness;
+  uint  flags;
+  uint  frame;
+} push_constant;
+
+const uint Present_Tonemap = 1u << 0;
+const uint Present_Gamma   = 1u << 1;
+const uint Present_Dither  = 1u << 2;
+
+vec3 tonemap_aces(vec3 x)
+{
+  const float a = 2.51;
+  const float b = 0.03;
+  const float c = 2.43;
+  const float d = 0.59;
+  const float e = 0.14;
+  return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0., 1.);
+}
+
+vec3 srgb_encode(vec3 c)
+{
+  return mix(c * 12.92, 1.055 * pow(c, vec3(1. / 2.4)) - .055, step(vec3(.0031308), c));
+}
+
+float hash(uvec3 v)
+{
+  v = v * 1664525u + 1013904223u;
+  v.x += v.y * v.z;
+  v.y += v.z * v.x;
+  v.z += v.x * v.y;
+  v ^= v >> 16u;
+  v.x += v.y * v.z;
+  return float(v.x) / 4294967295.;
+}
+
+vec3 output_transform(vec3 color, ivec2 texel_coord)
+{
+  if ((push_constant.flags & Present_Tonemap) != 0)
+    color = tonemap_aces(max(color, vec3(0.)));
+  if ((push_constant.flags & Present_Gamma) != 0)
+    color = srgb_encode(clamp(color, 0., 1.));
+  if ((push_constant.flags & Present_Dither) != 0)
+  {
+    uvec3 seed = uvec3(texel_coord, push_constant.frame);
+    float n    = hash(seed) + hash(seed + 0x9e37u) - 1.;
+    color += n / 255.;
+  }
+  return color;
+}
@@ -2,6 +2,7 @@
 #extension GL_EXT_buffer_reference : require
 
 layout (location = 0) out vec3 out_color;
+layout (location = 1) out vec2 out_uv;
 
 struct Vertex
 {
@@ -17,17 +18,36 @@ layout (buffer_reference, std430) readonly buffer VertexBuffer
   Vertex vertices[];
 };
 
+// same as CameraData and ObjectData, in frame data buffer
+layout (buffer_reference, std430) readonly buffer Camera
+{
+  mat4 view;
+  mat4 proj;
+  mat4 view_proj;
+  vec4 position;
+};
+
+layout (buffer_reference, std430) readonly buffer Objects
+{
+  mat4 world_matrices[];
+};
+
 layout (push_constant) uniform PushConstant 
 {
-  mat4         world_matrix;
+  Camera       camera;
+  Objects      objects;
   VertexBuffer vertex_buffer;
+  uint         texture_index;
+  float        min_lod;
 } push_constant;
 
 void main()
 {
   Vertex vertex = push_constant.vertex_buffer.vertices[gl_VertexIndex];
+  mat4   world  = push_constant.objects.world_matrices[gl_InstanceIndex];
 
-  gl_Position = push_constant.world_matrix * vec4(vertex.pos, 1.f);
+  gl_Position = push_constant.camera.view_proj * world * vec4(vertex.pos, 1.f);
 
   out_color = vertex.color.xyz;
+  out_uv    = vec2(vertex.uv_x, vertex.uv_y);
 }
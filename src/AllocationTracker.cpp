@@ -0,0 +1,133 @@
+#include "AllocationTracker.hpp"
+
+#ifdef TK_ALLOCATION_TRACKING
+
+#include "Log.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+namespace tk
+{
+
+namespace
+{
+  // scopes are registered at first use and never removed,
+  // more scopes than table are counted as other
+  constexpr uint32_t Max_Scope_Count = 32;
+
+  struct Counter
+  {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+
+    void add(uint64_t size) noexcept
+    {
+      count.fetch_add(1,    std::memory_order_relaxed);
+      bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    // read and reset for next frame
+    auto take() noexcept
+    {
+      return std::pair(count.exchange(0, std::memory_order_relaxed), bytes.exchange(0, std::memory_order_relaxed));
+    }
+  };
+
+  struct ScopeStats
+  {
+    std::atomic<char const*> name;
+    Counter                  cpu_allocate;
+    Counter                  cpu_free;
+    Counter                  gpu_allocate;
+    Counter                  gpu_free;
+  };
+
+  // first one is other
+  std::array<ScopeStats, Max_Scope_Count> Scopes;
+
+  thread_local uint32_t Current_Scope = 0;
+  // allocations of report itself are ignored
+  thread_local bool     Reporting     = false;
+
+  auto get_scope_index(char const* name) noexcept -> uint32_t
+  {
+    for (uint32_t i = 1; i < Scopes.size(); ++i)
+    {
+      auto current = Scopes[i].name.load(std::memory_order_acquire);
+      if (current == nullptr)
+      {
+        if (Scopes[i].name.compare_exchange_strong(current, name, std::memory_order_acq_rel))
+          return i;
+      }
+      // same literal may have different addresses in different translation units
+      if (current == name || std::strcmp(current, name) == 0)
+        return i;
+    }
+    return 0;
+  }
+}
+
+AllocationScope::AllocationScope(char const* name) noexcept
+  : _parent(std::exchange(Current_Scope, get_scope_index(name)))
+{
+}
+
+AllocationScope::~AllocationScope()
+{
+  Current_Scope = _parent;
+}
+
+namespace allocation_tracker
+{
+
+void on_cpu_allocate(size_t size) noexcept
+{
+  if (!Reporting)
+    Scopes[Current_Scope].cpu_allocate.add(size);
+}
+
+void on_cpu_free(size_t size) noexcept
+{
+  if (!Reporting)
+    Scopes[Current_Scope].cpu_free.add(size);
+}
+
+void on_gpu_allocate(uint64_t size) noexcept
+{
+  Scopes[Current_Scope].gpu_allocate.add(size);
+}
+
+void on_gpu_free(uint64_t size) noexcept
+{
+  Scopes[Current_Scope].gpu_free.add(size);
+}
+
+void end_frame(uint64_t frame)
+{
+  Reporting = true;
+  for (auto& scope : Scopes)
+  {
+    auto [cpu_allocs, cpu_allocate_bytes] = scope.cpu_allocate.take();
+    auto [cpu_frees,  cpu_free_bytes]     = scope.cpu_free.take();
+    auto [gpu_allocs, gpu_allocate_bytes] = scope.gpu_allocate.take();
+    auto [gpu_frees,  gpu_free_bytes]     = scope.gpu_free.take();
+    if (cpu_allocs == 0 && cpu_frees == 0 && gpu_allocs == 0 && gpu_frees == 0)
+      continue;
+
+    auto name = scope.name.load(std::memory_order_acquire);
+    log::info("allocation frame {} {:<20} cpu: {} new {} bytes, {} delete {} bytes | gpu: {} allocate {} bytes, {} free {} bytes",
+              frame, name ? name : "other",
+              cpu_allocs, cpu_allocate_bytes, cpu_frees, cpu_free_bytes,
+              gpu_allocs, gpu_allocate_bytes, gpu_frees, gpu_free_bytes);
+  }
+  Reporting = false;
+}
+
+}
+
+}
+
+#endif
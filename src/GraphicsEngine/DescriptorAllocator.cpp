@@ -0,0 +1,96 @@
+#include "DescriptorAllocator.hpp"
+#include "ErrorHandling.hpp"
+#include "HeapGuard.hpp"
+
+#include <algorithm>
+
+namespace tk { namespace graphics_engine {
+
+void DescriptorAllocator::init(VkDevice device, uint32_t sets_per_pool, std::span<PoolRatio const> ratios)
+{
+  _device        = device;
+  _ratios.assign(ratios.begin(), ratios.end());
+  _sets_per_pool = sets_per_pool;
+  _ready_pools.emplace_back(create_pool(sets_per_pool));
+}
+
+void DescriptorAllocator::destroy()
+{
+  for (auto pool : _ready_pools)
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+  for (auto pool : _full_pools)
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+  _ready_pools.clear();
+  _full_pools.clear();
+}
+
+auto DescriptorAllocator::allocate(VkDescriptorSetLayout layout) -> VkDescriptorSet
+{
+  VkDescriptorSetAllocateInfo info
+  {
+    .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool     = get_pool(),
+    .descriptorSetCount = 1,
+    .pSetLayouts        = &layout,
+  };
+  VkDescriptorSet set;
+  auto res = vkAllocateDescriptorSets(_device, &info, &set);
+
+  // pool is full, continue with next one
+  if (res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL)
+  {
+    auto allow_heap = AllowHeapScope();
+    _full_pools.emplace_back(_ready_pools.back());
+    _ready_pools.pop_back();
+    info.descriptorPool = get_pool();
+    res = vkAllocateDescriptorSets(_device, &info, &set);
+  }
+  throw_if(res != VK_SUCCESS, "failed to allocate descriptor set");
+  return set;
+}
+
+void DescriptorAllocator::reset()
+{
+  for (auto pool : _ready_pools)
+    vkResetDescriptorPool(_device, pool, 0);
+  for (auto pool : _full_pools)
+  {
+    vkResetDescriptorPool(_device, pool, 0);
+    _ready_pools.emplace_back(pool);
+  }
+  _full_pools.clear();
+}
+
+auto DescriptorAllocator::get_pool() -> VkDescriptorPool
+{
+  if (!_ready_pools.empty())
+    return _ready_pools.back();
+
+  // grow for next time, usage of a frame rarely changes much
+  auto allow_heap = AllowHeapScope();
+  auto pool       = create_pool(_sets_per_pool);
+  _sets_per_pool  = std::min(Max_Sets_Per_Pool, _sets_per_pool + _sets_per_pool / 2);
+  _ready_pools.emplace_back(pool);
+  return pool;
+}
+
+auto DescriptorAllocator::create_pool(uint32_t set_count) -> VkDescriptorPool
+{
+  auto sizes = std::vector<VkDescriptorPoolSize>();
+  for (auto const& ratio : _ratios)
+    sizes.emplace_back(ratio.type, std::max(1u, (uint32_t)(ratio.ratio * set_count)));
+
+  VkDescriptorPoolCreateInfo info
+  {
+    .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets       = set_count,
+    .poolSizeCount = (uint32_t)sizes.size(),
+    .pPoolSizes    = sizes.data(),
+  };
+  VkDescriptorPool pool;
+  throw_if(vkCreateDescriptorPool(_device, &info, nullptr, &pool) != VK_SUCCESS,
+           "failed to create descriptor pool");
+  return pool;
+}
+
+} }
@@ -0,0 +1,93 @@
+#include "DescriptorCache.hpp"
+
+#include <functional>
+
+namespace tk { namespace graphics_engine {
+
+bool DescriptorCache::Binding::operator==(Binding const& other) const noexcept
+{
+  return binding            == other.binding            &&
+         type               == other.type               &&
+         image.sampler      == other.image.sampler      &&
+         image.imageView    == other.image.imageView    &&
+         image.imageLayout  == other.image.imageLayout  &&
+         buffer.buffer      == other.buffer.buffer      &&
+         buffer.offset      == other.buffer.offset      &&
+         buffer.range       == other.buffer.range;
+}
+
+bool DescriptorCache::Binding::uses(uint64_t handle) const noexcept
+{
+  return (uint64_t)image.sampler == handle || (uint64_t)image.imageView == handle || (uint64_t)buffer.buffer == handle;
+}
+
+auto DescriptorCache::KeyHash::operator()(Key const& key) const noexcept -> size_t
+{
+  auto hash    = std::hash<uint64_t>{}((uint64_t)key.layout);
+  auto combine = [&](uint64_t value) { hash ^= std::hash<uint64_t>{}(value) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2); };
+  for (auto const& binding : key.bindings)
+  {
+    combine(binding.binding);
+    combine(binding.type);
+    combine((uint64_t)binding.image.sampler);
+    combine((uint64_t)binding.image.imageView);
+    combine(binding.image.imageLayout);
+    combine((uint64_t)binding.buffer.buffer);
+    combine(binding.buffer.offset);
+    combine(binding.buffer.range);
+  }
+  return hash;
+}
+
+void DescriptorCache::init(VkDevice device, std::span<DescriptorAllocator::PoolRatio const> ratios)
+{
+  _device = device;
+  _allocator.init(device, 16, ratios);
+}
+
+void DescriptorCache::destroy()
+{
+  _sets.clear();
+  _free_sets.clear();
+  _allocator.destroy();
+}
+
+auto DescriptorCache::get(VkDescriptorSetLayout layout, std::span<Binding const> bindings) -> VkDescriptorSet
+{
+  auto key = Key{ layout, { bindings.begin(), bindings.end() } };
+  if (auto it = _sets.find(key); it != _sets.end())
+    return it->second;
+
+  // reuse set of same layout which was evicted
+  VkDescriptorSet set;
+  if (auto& free_sets = _free_sets[layout]; !free_sets.empty())
+  {
+    set = free_sets.back();
+    free_sets.pop_back();
+  }
+  else
+    set = _allocator.allocate(layout);
+
+  auto writes = std::vector<VkWriteDescriptorSet>();
+  for (auto const& binding : bindings)
+  {
+    auto is_buffer = binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+                     binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes.push_back(
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = set,
+      .dstBinding      = binding.binding,
+      .descriptorCount = 1,
+      .descriptorType  = binding.type,
+      .pImageInfo      = is_buffer ? nullptr         : &binding.image,
+      .pBufferInfo     = is_buffer ? &binding.buffer : nullptr,
+    });
+  }
+  vkUpdateDescriptorSets(_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+  _sets.emplace(std::move(key), set);
+  return set;
+}
+
+} }
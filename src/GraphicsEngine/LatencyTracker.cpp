@@ -0,0 +1,172 @@
+#include "LatencyTracker.hpp"
+#include "Log.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace tk { namespace graphics_engine {
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Histogram
+////////////////////////////////////////////////////////////////////////////////
+
+void LatencyHistogram::add(uint64_t ns)
+{
+  auto us = ns / 1000;
+  auto it = std::lower_bound(Bucket_Bounds.begin(), Bucket_Bounds.end(), us);
+  ++_buckets[it - Bucket_Bounds.begin()];
+  ++_count;
+  _sum += us;
+  _max  = std::max(_max, us);
+}
+
+void LatencyHistogram::clear()
+{
+  _buckets = {};
+  _count   = 0;
+  _sum     = 0;
+  _max     = 0;
+}
+
+// return upper bound of bucket which contains the percentile
+auto LatencyHistogram::percentile(float p) const -> uint64_t
+{
+  auto target = (uint32_t)std::ceil(_count * p);
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < Bucket_Bounds.size(); ++i)
+  {
+    acc += _buckets[i];
+    if (acc >= target)
+      return Bucket_Bounds[i];
+  }
+  return _max;
+}
+
+void LatencyHistogram::report(std::string_view name) const
+{
+  if (_count == 0)
+    return;
+
+  std::string buckets;
+  for (uint32_t i = 0; i < _buckets.size(); ++i)
+  {
+    if (_buckets[i] == 0)
+      continue;
+    if (i < Bucket_Bounds.size())
+      buckets += std::format(" <{}ms:{}", Bucket_Bounds[i] / 1000, _buckets[i]);
+    else
+      buckets += std::format(" >={}ms:{}", Bucket_Bounds.back() / 1000, _buckets[i]);
+  }
+
+  log::info("latency {:<16} n={:<4} avg={:.2f}ms p50<={}ms p99<={}ms max={:.2f}ms |{}",
+            name, _count, _sum / 1000.f / _count, percentile(.5f) / 1000, percentile(.99f) / 1000,
+            _max / 1000.f, buckets);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Tracker
+////////////////////////////////////////////////////////////////////////////////
+
+auto LatencyTracker::now() -> uint64_t
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyTracker::on_input(uint64_t timestamp)
+{
+  // only keep the oldest input, all inputs before next update are handled by same frame
+  if (_pending_input == 0)
+    _pending_input = timestamp;
+}
+
+void LatencyTracker::on_update()
+{
+  // previous input still not be presented, e.g. swapchain out of date
+  if (_latched || _pending_input == 0)
+    return;
+
+  _current        = {};
+  _current.input  = _pending_input;
+  _current.update = now();
+  _pending_input  = 0;
+  _latched        = true;
+}
+
+void LatencyTracker::on_record()
+{
+  if (_latched)
+    _current.record = now();
+}
+
+void LatencyTracker::on_submit()
+{
+  if (_latched)
+    _current.submit = now();
+}
+
+void LatencyTracker::on_present(uint32_t present_id, bool wait_display_time)
+{
+  if (!_latched)
+    return;
+
+  _current.present    = now();
+  _current.present_id = present_id;
+  _latched            = false;
+
+  finish(_current);
+
+  // override oldest one when display time never come back
+  if (wait_display_time)
+  {
+    _wait_display[_wait_display_index] = _current;
+    _wait_display_index = (_wait_display_index + 1) % Max_Pending_Display;
+  }
+}
+
+void LatencyTracker::on_display(uint32_t present_id, uint64_t display_time)
+{
+  for (auto& sample : _wait_display)
+  {
+    if (sample.input != 0 && sample.present_id == present_id)
+    {
+      if (display_time > sample.input)
+        _input_to_display.add(display_time - sample.input);
+      sample = {};
+      return;
+    }
+  }
+}
+
+void LatencyTracker::finish(LatencySample const& sample)
+{
+  _input_to_update.add(sample.update - sample.input);
+  _input_to_submit.add(sample.submit - sample.input);
+  _input_to_present.add(sample.present - sample.input);
+}
+
+void LatencyTracker::end_frame()
+{
+  auto time = now();
+  if (_last_report == 0)
+    _last_report = time;
+  if (time - _last_report < Report_Interval)
+    return;
+  _last_report = time;
+
+  if (_input_to_update.count() == 0)
+    return;
+
+  _input_to_update.report("input->update");
+  _input_to_submit.report("input->submit");
+  _input_to_present.report("input->present");
+  _input_to_display.report("input->display");
+
+  _input_to_update.clear();
+  _input_to_submit.clear();
+  _input_to_present.clear();
+  _input_to_display.clear();
+}
+
+} }
@@ -0,0 +1,68 @@
+#include "MappedFile.hpp"
+#include "ErrorHandling.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace tk { namespace graphics_engine {
+
+MappedFile::MappedFile(std::filesystem::path const& path)
+{
+  auto fd = open(path.c_str(), O_RDONLY);
+  throw_if(fd == -1, "failed to open {}", path.string());
+
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    close(fd);
+    throw_if(true, "failed to get size of {}", path.string());
+  }
+
+  // mmap can't map empty file
+  _size = st.st_size;
+  if (_size > 0)
+  {
+    auto ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    throw_if(ptr == MAP_FAILED, "failed to map {}", path.string());
+    _data = static_cast<std::byte const*>(ptr);
+    return;
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : _data(std::exchange(other._data, nullptr)),
+    _size(std::exchange(other._size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    unmap();
+    _data = std::exchange(other._data, nullptr);
+    _size = std::exchange(other._size, 0);
+  }
+  return *this;
+}
+
+void MappedFile::unmap() noexcept
+{
+  if (_data)
+    munmap(const_cast<std::byte*>(_data), _size);
+  _data = nullptr;
+  _size = 0;
+}
+
+} }
@@ -0,0 +1,233 @@
+#include "MeshCache.hpp"
+#include "ErrorHandling.hpp"
+#include "Log.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <bit>
+
+namespace tk { namespace graphics_engine {
+
+// bump when layout of file, Vertex or GeometrySurface or import processing changed
+static constexpr uint32_t Mesh_Cache_Version = 6;
+static constexpr char     Mesh_Cache_Magic[4] = { 'T', 'K', 'M', 'S' };
+static constexpr uint64_t Mesh_Cache_Align    = 16;
+
+struct MeshCacheHeader
+{
+  char     magic[4];
+  uint32_t version;
+  uint64_t source_hash;
+  uint32_t vertex_size;
+  uint32_t mesh_count;
+};
+
+struct MeshCacheEntry
+{
+  uint64_t name_offset;
+  uint64_t surface_offset;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint64_t meshlet_offset;
+  uint32_t name_size;
+  uint32_t surface_count;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t meshlet_count;
+  Bounds   bounds;
+};
+
+static auto align_up(uint64_t v) -> uint64_t
+{
+  return (v + Mesh_Cache_Align - 1) & ~(Mesh_Cache_Align - 1);
+}
+
+// FNV-1a over 8 bytes words, only used to detect changed content
+auto hash_bytes(std::span<std::byte const> bytes, uint64_t hash) -> uint64_t
+{
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes.data() + i, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3;
+  }
+  for (; i < bytes.size(); ++i)
+    hash = (hash ^ (uint64_t)bytes[i]) * 0x100000001b3;
+  return hash ^ bytes.size();
+}
+
+// multiply and rotate over 8 bytes words, then finalized by murmur3 mixer
+auto check_hash_bytes(std::span<std::byte const> bytes, uint64_t hash) -> uint64_t
+{
+  auto mix = [&](uint64_t word)
+  {
+    hash = std::rotl(hash ^ (word * 0x87c37b91114253d5), 31) * 0x4cf5ad432745937f;
+  };
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes.data() + i, sizeof(word));
+    mix(word);
+  }
+  for (; i < bytes.size(); ++i)
+    mix((uint64_t)bytes[i]);
+
+  hash ^= bytes.size();
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+auto hash_file(std::filesystem::path const& path) -> uint64_t
+{
+  auto file = MappedFile(path);
+  return hash_bytes(file.data());
+}
+
+auto read_mesh_cache(std::filesystem::path const& path, uint64_t source_hash, MappedFile& file) -> std::optional<std::vector<CookedMesh>>
+{
+  if (!std::filesystem::exists(path))
+    return std::nullopt;
+
+  try
+  {
+    file = MappedFile(path);
+  }
+  catch (std::exception const& e)
+  {
+    log::error(e.what());
+    return std::nullopt;
+  }
+
+  auto bytes  = file.data();
+  auto in_file = [&](uint64_t offset, uint64_t size)
+  {
+    return offset <= bytes.size() && size <= bytes.size() - offset;
+  };
+
+  MeshCacheHeader header;
+  if (!in_file(0, sizeof(header)))
+    return std::nullopt;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, Mesh_Cache_Magic, sizeof(header.magic)) != 0 ||
+      header.version     != Mesh_Cache_Version                                ||
+      header.source_hash != source_hash                                       ||
+      header.vertex_size != sizeof(Vertex)                                    ||
+      !in_file(sizeof(header), (uint64_t)header.mesh_count * sizeof(MeshCacheEntry)))
+    return std::nullopt;
+
+  std::vector<CookedMesh> meshs(header.mesh_count);
+  for (uint32_t i = 0; i < header.mesh_count; ++i)
+  {
+    MeshCacheEntry entry;
+    std::memcpy(&entry, bytes.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+    if (!in_file(entry.name_offset,    entry.name_size)                                   ||
+        !in_file(entry.surface_offset, (uint64_t)entry.surface_count * sizeof(GeometrySurface)) ||
+        !in_file(entry.vertex_offset,  (uint64_t)entry.vertex_count  * sizeof(Vertex))    ||
+        !in_file(entry.index_offset,   (uint64_t)entry.index_count   * sizeof(uint32_t))  ||
+        !in_file(entry.meshlet_offset, (uint64_t)entry.meshlet_count * sizeof(Meshlet))   ||
+        entry.vertex_offset  % Mesh_Cache_Align != 0                                      ||
+        entry.index_offset   % Mesh_Cache_Align != 0                                      ||
+        entry.meshlet_offset % Mesh_Cache_Align != 0)
+      return std::nullopt;
+
+    auto& mesh  = meshs[i];
+    mesh.name   = std::string(reinterpret_cast<char const*>(bytes.data() + entry.name_offset), entry.name_size);
+    mesh.bounds = entry.bounds;
+    mesh.surfaces.resize(entry.surface_count);
+    std::memcpy(mesh.surfaces.data(), bytes.data() + entry.surface_offset, entry.surface_count * sizeof(GeometrySurface));
+
+    // no copy, point into mapped file, mapping is page aligned so offsets keep alignment
+    mesh.data.vertices = { reinterpret_cast<Vertex const*>(bytes.data() + entry.vertex_offset), entry.vertex_count };
+    mesh.data.indices  = { reinterpret_cast<uint32_t const*>(bytes.data() + entry.index_offset), entry.index_count };
+    mesh.data.meshlets = { reinterpret_cast<Meshlet const*>(bytes.data() + entry.meshlet_offset), entry.meshlet_count };
+  }
+
+  return meshs;
+}
+
+void write_mesh_cache(std::filesystem::path const& path, uint64_t source_hash, std::span<CookedMesh const> meshs)
+{
+  //
+  // compute offsets of all sections
+  //
+  std::vector<MeshCacheEntry> entries(meshs.size());
+  uint64_t offset = sizeof(MeshCacheHeader) + meshs.size() * sizeof(MeshCacheEntry);
+  for (uint32_t i = 0; i < meshs.size(); ++i)
+  {
+    entries[i].name_offset = offset;
+    entries[i].name_size   = meshs[i].name.size();
+    offset += meshs[i].name.size();
+  }
+  for (uint32_t i = 0; i < meshs.size(); ++i)
+  {
+    entries[i].surface_offset = offset;
+    entries[i].surface_count  = meshs[i].surfaces.size();
+    offset += meshs[i].surfaces.size() * sizeof(GeometrySurface);
+  }
+  for (uint32_t i = 0; i < meshs.size(); ++i)
+  {
+    entries[i].vertex_offset  = offset = align_up(offset);
+    entries[i].vertex_count   = meshs[i].data.vertices.size();
+    offset += meshs[i].data.vertices.size_bytes();
+    entries[i].index_offset   = offset = align_up(offset);
+    entries[i].index_count    = meshs[i].data.indices.size();
+    offset += meshs[i].data.indices.size_bytes();
+    entries[i].meshlet_offset = offset = align_up(offset);
+    entries[i].meshlet_count  = meshs[i].data.meshlets.size();
+    offset += meshs[i].data.meshlets.size_bytes();
+    entries[i].bounds         = meshs[i].bounds;
+  }
+
+  //
+  // write to temporary file
+  //
+  auto tmp_path = std::filesystem::path(path).concat(".tmp");
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    throw_if(!file.is_open(), "failed to create {}", tmp_path.string());
+
+    MeshCacheHeader header
+    {
+      .version     = Mesh_Cache_Version,
+      .source_hash = source_hash,
+      .vertex_size = sizeof(Vertex),
+      .mesh_count  = (uint32_t)meshs.size(),
+    };
+    std::memcpy(header.magic, Mesh_Cache_Magic, sizeof(header.magic));
+
+    auto write = [&](void const* data, uint64_t size)
+    {
+      file.write(reinterpret_cast<char const*>(data), size);
+    };
+    auto pad = [&](uint64_t offset)
+    {
+      static constexpr char Zeros[Mesh_Cache_Align] = {};
+      write(Zeros, offset - file.tellp());
+    };
+
+    write(&header, sizeof(header));
+    write(entries.data(), entries.size() * sizeof(MeshCacheEntry));
+    for (auto const& mesh : meshs)
+      write(mesh.name.data(), mesh.name.size());
+    for (auto const& mesh : meshs)
+      write(mesh.surfaces.data(), mesh.surfaces.size() * sizeof(GeometrySurface));
+    for (uint32_t i = 0; i < meshs.size(); ++i)
+    {
+      pad(entries[i].vertex_offset);
+      write(meshs[i].data.vertices.data(), meshs[i].data.vertices.size_bytes());
+      pad(entries[i].index_offset);
+      write(meshs[i].data.indices.data(), meshs[i].data.indices.size_bytes());
+      pad(entries[i].meshlet_offset);
+      write(meshs[i].data.meshlets.data(), meshs[i].data.meshlets.size_bytes());
+    }
+    throw_if(!file.good(), "failed to write {}", tmp_path.string());
+  }
+
+  std::filesystem::rename(tmp_path, path);
+}
+
+} }
@@ -0,0 +1,266 @@
+#include "MeshOptimizer.hpp"
+
+#include <unordered_map>
+#include <string_view>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+namespace tk { namespace graphics_engine {
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Weld
+////////////////////////////////////////////////////////////////////////////////
+
+void weld_vertices(std::vector<Vertex>& vertices, std::span<uint32_t> indices)
+{
+  static_assert(sizeof(Vertex) == 48, "Vertex should not have padding to compare by bytes");
+
+  // compare by bytes, only exactly same vertices are merged
+  auto key = [&](uint32_t i)
+  {
+    return std::string_view(reinterpret_cast<char const*>(&vertices[i]), sizeof(Vertex));
+  };
+
+  std::unordered_map<std::string_view, uint32_t> unique;
+  unique.reserve(vertices.size());
+  std::vector<uint32_t> remap(vertices.size());
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < vertices.size(); ++i)
+  {
+    // compact in place, keys only point to vertices before count which are never overwritten
+    vertices[count] = vertices[i];
+    auto [it, inserted] = unique.try_emplace(key(count), count);
+    remap[i] = it->second;
+    if (inserted)
+      ++count;
+  }
+  vertices.resize(count);
+
+  for (auto& idx : indices)
+    idx = remap[idx];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Vertex Cache
+////////////////////////////////////////////////////////////////////////////////
+
+auto optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count) -> std::vector<uint32_t>
+{
+  auto triangle_count = (uint32_t)indices.size() / 3;
+  std::vector<uint32_t> clusters;
+  if (triangle_count == 0)
+    return clusters;
+
+  //
+  // vertex to triangles adjacency in CSR
+  //
+  std::vector<uint32_t> live(vertex_count, 0);
+  for (auto idx : indices)
+    ++live[idx];
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  std::partial_sum(live.begin(), live.end(), offsets.begin() + 1);
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    auto fill = std::vector<uint32_t>(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < indices.size(); ++i)
+      adjacency[fill[indices[i]]++] = i / 3;
+  }
+
+  //
+  // Tipsify
+  //
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache_time(vertex_count, 0);
+  std::vector<bool>     emitted(triangle_count, false);
+  std::vector<uint32_t> dead_end;
+  std::vector<uint32_t> candidates;
+  uint32_t time   = Vertex_Cache_Size + 1;
+  uint32_t cursor = 0;
+  int64_t  fan    = indices[0];
+
+  clusters.push_back(0);
+  while (fan >= 0)
+  {
+    // emit all triangles around fan vertex
+    candidates.clear();
+    for (auto i = offsets[fan]; i < offsets[fan + 1]; ++i)
+    {
+      auto t = adjacency[i];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+      for (uint32_t k = 0; k < 3; ++k)
+      {
+        auto v = indices[t * 3 + k];
+        result.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - cache_time[v] > Vertex_Cache_Size)
+          cache_time[v] = time++;
+      }
+    }
+
+    // next fan is the one still in cache after its triangles emitted
+    fan = -1;
+    int64_t best = -1;
+    for (auto v : candidates)
+    {
+      if (live[v] == 0)
+        continue;
+      int64_t priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= Vertex_Cache_Size)
+        priority = time - cache_time[v];
+      if (priority > best)
+      {
+        best = priority;
+        fan  = v;
+      }
+    }
+    if (fan >= 0)
+      continue;
+
+    // dead end, find from recent vertices then by cursor, these start new clusters
+    while (!dead_end.empty() && fan < 0)
+    {
+      auto v = dead_end.back();
+      dead_end.pop_back();
+      if (live[v] > 0)
+        fan = v;
+    }
+    while (cursor < vertex_count && fan < 0)
+    {
+      if (live[cursor] > 0)
+        fan = cursor;
+      ++cursor;
+    }
+    if (fan >= 0)
+      clusters.push_back(result.size() / 3);
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+  return clusters;
+}
+
+auto analyze_vertex_cache(std::span<uint32_t const> indices, uint32_t vertex_count) -> float
+{
+  if (indices.empty())
+    return 0.f;
+
+  // FIFO cache, vertex is in cache when its insert time is in last Vertex_Cache_Size inserts
+  std::vector<uint32_t> insert_time(vertex_count, 0);
+  uint32_t time   = Vertex_Cache_Size + 1;
+  uint32_t misses = 0;
+  for (auto v : indices)
+  {
+    if (time - insert_time[v] > Vertex_Cache_Size)
+    {
+      insert_time[v] = time++;
+      ++misses;
+    }
+  }
+  return misses / (indices.size() / 3.f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Overdraw
+////////////////////////////////////////////////////////////////////////////////
+
+void optimize_overdraw(std::span<uint32_t> indices, std::span<Vertex const> vertices, std::span<uint32_t const> clusters)
+{
+  auto triangle_count = (uint32_t)indices.size() / 3;
+  if (clusters.size() < 2)
+    return;
+
+  //
+  // area weighted centroid and normal of mesh and clusters
+  //
+  struct Cluster
+  {
+    uint32_t  start;
+    uint32_t  end;
+    glm::vec3 centroid = {};
+    glm::vec3 normal   = {};
+    float     area     = 0.f;
+    float     sort_key = 0.f;
+  };
+  std::vector<Cluster> infos(clusters.size());
+  glm::vec3 mesh_centroid = {};
+  float     mesh_area     = 0.f;
+  for (uint32_t c = 0; c < clusters.size(); ++c)
+  {
+    auto& info = infos[c];
+    info.start = clusters[c];
+    info.end   = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+    for (auto t = info.start; t < info.end; ++t)
+    {
+      auto& p0 = vertices[indices[t * 3 + 0]].pos;
+      auto& p1 = vertices[indices[t * 3 + 1]].pos;
+      auto& p2 = vertices[indices[t * 3 + 2]].pos;
+      auto  n  = glm::cross(p1 - p0, p2 - p0);
+      auto  a  = glm::length(n);
+      info.centroid += (p0 + p1 + p2) * (a / 3.f);
+      info.normal   += n;
+      info.area     += a;
+    }
+    mesh_centroid += info.centroid;
+    mesh_area     += info.area;
+    if (info.area > 0.f)
+      info.centroid /= info.area;
+  }
+  if (mesh_area > 0.f)
+    mesh_centroid /= mesh_area;
+
+  // clusters facing away from center are likely occluders, draw them first
+  for (auto& info : infos)
+  {
+    auto len = glm::length(info.normal);
+    info.sort_key = len > 0.f ? glm::dot(info.centroid - mesh_centroid, info.normal / len) : 0.f;
+  }
+  std::stable_sort(infos.begin(), infos.end(), [](auto const& a, auto const& b) { return a.sort_key > b.sort_key; });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (auto const& info : infos)
+    result.insert(result.end(), indices.begin() + info.start * 3, indices.begin() + info.end * 3);
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Vertex Fetch
+////////////////////////////////////////////////////////////////////////////////
+
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::span<uint32_t> indices)
+{
+  // new index is the order of first use, unused vertices are dropped
+  static constexpr auto Unused = ~0u;
+  std::vector<uint32_t> remap(vertices.size(), Unused);
+  std::vector<Vertex>   result;
+  result.reserve(vertices.size());
+  for (auto& idx : indices)
+  {
+    if (remap[idx] == Unused)
+    {
+      remap[idx] = result.size();
+      result.push_back(vertices[idx]);
+    }
+    idx = remap[idx];
+  }
+  vertices = std::move(result);
+}
+
+void optimize_mesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::span<GeometrySurface const> surfaces)
+{
+  weld_vertices(vertices, indices);
+  for (auto const& surface : surfaces)
+  {
+    auto range    = std::span(indices).subspan(surface.start_index, surface.count);
+    auto clusters = optimize_vertex_cache(range, vertices.size());
+    optimize_overdraw(range, vertices, clusters);
+  }
+  optimize_vertex_fetch(vertices, indices);
+}
+
+} }
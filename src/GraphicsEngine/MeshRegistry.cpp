@@ -0,0 +1,223 @@
+#include "MeshRegistry.hpp"
+#include "GraphicsEngine.hpp"
+#include "Log.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+namespace tk { namespace graphics_engine {
+
+static auto get_key(std::filesystem::path const& path)
+{
+  return std::filesystem::weakly_canonical(path).string();
+}
+
+auto MeshRegistry::load(std::filesystem::path const& path, bool build_meshlets) -> MeshHandles
+{
+  prune();
+
+  auto key         = get_key(path);
+  auto source_hash = hash_file(path);
+  if (auto meshs = find_file(key, source_hash, build_meshlets))
+    return *meshs;
+
+  auto cooked = cook_gltf(path, source_hash, build_meshlets);
+  auto meshs  = upload(cooked);
+  add_file(key, source_hash, build_meshlets, meshs);
+  return meshs;
+}
+
+auto MeshRegistry::load_async(std::filesystem::path const& path, bool build_meshlets) -> std::shared_ptr<MeshRequest>
+{
+  prune();
+
+  auto key = get_key(path);
+  for (auto const& pending : _pending)
+    if (pending.key == key && pending.build_meshlets == build_meshlets)
+      return pending.request;
+
+  // source is read by worker, file is only known to be unchanged after hashing
+  auto request  = std::make_shared<MeshRequest>();
+  request->path = path;
+  _pending.emplace_back(PendingRequest
+  {
+    .key            = key,
+    .build_meshlets = build_meshlets,
+    .request        = request,
+    .result         = std::async(std::launch::async, [path, build_meshlets]
+    {
+      auto source_hash = hash_file(path);
+      return CookResult{ source_hash, cook_gltf(path, source_hash, build_meshlets) };
+    }),
+  });
+  return request;
+}
+
+void MeshRegistry::poll()
+{
+  std::erase_if(_pending, [this](auto& pending)
+  {
+    if (pending.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return false;
+
+    try
+    {
+      auto [source_hash, cooked] = pending.result.get();
+      if (auto meshs = find_file(pending.key, source_hash, pending.build_meshlets))
+        pending.request->meshs = std::move(*meshs);
+      else
+      {
+        pending.request->meshs = upload(cooked);
+        add_file(pending.key, source_hash, pending.build_meshlets, pending.request->meshs);
+      }
+      pending.request->status = MeshRequest::Status::Ready;
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to load {}: {}", pending.request->path.string(), e.what());
+      pending.request->status = MeshRequest::Status::Failed;
+    }
+    return true;
+  });
+}
+
+void MeshRegistry::clear()
+{
+  for (auto& pending : _pending)
+    pending.result.wait();
+  _pending.clear();
+  _files.clear();
+  _meshs.clear();
+}
+
+auto MeshRegistry::find_file(std::string const& key, uint64_t source_hash, bool build_meshlets) -> std::optional<MeshHandles>
+{
+  auto it = _files.find(key);
+  if (it == _files.end() || it->second.source_hash != source_hash || it->second.build_meshlets != build_meshlets)
+    return std::nullopt;
+
+  // file is loaded again when any mesh of it is released,
+  // alive meshs are still shared by content hash
+  auto meshs = MeshHandles();
+  for (auto const& weak : it->second.meshs)
+  {
+    auto mesh = weak.lock();
+    if (!mesh)
+      return std::nullopt;
+    meshs.emplace_back(std::move(mesh));
+  }
+  return meshs;
+}
+
+//
+// content hash only finds candidates, different meshs of same hash must not be shared.
+// alive mesh is compared by its content check and buffer sizes, its data is on GPU.
+//
+static auto same_surfaces(std::span<GeometrySurface const> a, std::span<GeometrySurface const> b)
+{
+  return std::ranges::equal(a, b, [](auto const& x, auto const& y)
+  {
+    return x.start_index == y.start_index && x.count == y.count && x.lod_count == y.lod_count && x.image == y.image;
+  });
+}
+
+static auto same_mesh(MeshAsset const& mesh, uint64_t content_check, CookedMesh const& cooked)
+{
+  auto const& buffer = mesh.mesh_buffer;
+  return content_check        == cooked.content_check              &&
+         buffer.vertices.size == cooked.data.vertices.size_bytes() &&
+         buffer.indices.size  == cooked.data.indices.size_bytes()  &&
+         buffer.meshlets.size == cooked.data.meshlets.size_bytes() &&
+         same_surfaces(mesh.surfaces, cooked.surfaces);
+}
+
+static auto same_mesh(CookedMesh const& a, CookedMesh const& b)
+{
+  return a.content_check == b.content_check                                                &&
+         std::ranges::equal(std::as_bytes(a.data.vertices), std::as_bytes(b.data.vertices)) &&
+         std::ranges::equal(std::as_bytes(a.data.indices),  std::as_bytes(b.data.indices))  &&
+         same_surfaces(a.surfaces, b.surfaces);
+}
+
+auto MeshRegistry::upload(CookedGltf& cooked) -> MeshHandles
+{
+  auto meshs   = MeshHandles(cooked.meshs.size());
+  auto datas   = std::vector<MeshData>();
+  auto uploads = std::vector<uint32_t>();
+
+  // same content may also repeat in one file, point to the first one
+  auto first = std::unordered_map<uint64_t, uint32_t>();
+  for (uint32_t m = 0; m < cooked.meshs.size(); ++m)
+  {
+    auto hash = cooked.meshs[m].content_hash;
+    if (auto it = _meshs.find(hash); it != _meshs.end())
+      if (auto mesh = it->second.mesh.lock(); mesh && same_mesh(*mesh, it->second.content_check, cooked.meshs[m]))
+      {
+        meshs[m] = std::move(mesh);
+        continue;
+      }
+    auto [slot, inserted] = first.try_emplace(hash, m);
+    if (inserted || !same_mesh(cooked.meshs[slot->second], cooked.meshs[m]))
+    {
+      datas.emplace_back(cooked.meshs[m].data);
+      uploads.emplace_back(m);
+    }
+  }
+
+  auto buffers  = _engine->create_mesh_buffers(datas);
+  auto engine   = _engine;
+  // textures are only created for images used by uploaded meshs
+  auto textures = std::vector<std::shared_ptr<Texture>>(cooked.images.size());
+  for (uint32_t i = 0; i < uploads.size(); ++i)
+  {
+    auto& cooked_mesh = cooked.meshs[uploads[i]];
+    for (auto const& surface : cooked_mesh.surfaces)
+      if (surface.image < textures.size() && !textures[surface.image] && !cooked.images[surface.image].empty())
+        textures[surface.image] = _engine->create_texture(std::move(cooked.images[surface.image]));
+
+    auto mesh = std::shared_ptr<MeshAsset>(new MeshAsset
+    {
+      .name        = std::move(cooked_mesh.name),
+      .surfaces    = std::move(cooked_mesh.surfaces),
+      .bounds      = cooked_mesh.bounds,
+      .mesh_buffer = buffers[i],
+      .textures    = textures,
+    },
+    [engine](MeshAsset* mesh)
+    {
+      engine->destroy_mesh_buffer(mesh->mesh_buffer);
+      delete mesh;
+    });
+    _engine->register_mesh_buffer(mesh->mesh_buffer);
+    _meshs[cooked_mesh.content_hash] = { mesh, cooked_mesh.content_check };
+    _engine->residency().track(mesh);
+    meshs[uploads[i]] = std::move(mesh);
+  }
+
+  for (uint32_t m = 0; m < cooked.meshs.size(); ++m)
+    if (!meshs[m])
+      meshs[m] = meshs[first[cooked.meshs[m].content_hash]];
+
+  log::info("mesh registry: {} meshs, {} uploaded, {} shared", meshs.size(), uploads.size(), meshs.size() - uploads.size());
+  return meshs;
+}
+
+void MeshRegistry::add_file(std::string const& key, uint64_t source_hash, bool build_meshlets, MeshHandles const& meshs)
+{
+  auto& entry          = _files[key];
+  entry.source_hash    = source_hash;
+  entry.build_meshlets = build_meshlets;
+  entry.meshs.assign(meshs.begin(), meshs.end());
+}
+
+// remove entries whose meshs are all released
+void MeshRegistry::prune()
+{
+  std::erase_if(_meshs, [](auto const& entry) { return entry.second.mesh.expired(); });
+  std::erase_if(_files, [](auto const& entry)
+  {
+    return std::ranges::all_of(entry.second.meshs, [](auto const& mesh) { return mesh.expired(); });
+  });
+}
+
+} }
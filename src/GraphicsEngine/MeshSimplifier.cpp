@@ -0,0 +1,294 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <unordered_map>
+#include <string_view>
+#include <algorithm>
+#include <cmath>
+
+namespace tk { namespace graphics_engine {
+
+// lods under this triangle count are not worth to generate
+static constexpr uint32_t Min_Lod_Triangle_Count = 32;
+// lod is dropped if it keeps more than this ratio of previous one
+static constexpr float    Min_Lod_Reduction      = .75f;
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Quadric
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// symmetric 4x4 matrix of plane equations, area weighted,
+// error is weighted mean of squared distance to planes.
+//
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0  = 0, b1  = 0, b2  = 0;
+  double c   = 0;
+  double w   = 0;
+
+  static auto from_plane(glm::vec3 n, float d, float weight)
+  {
+    Quadric q;
+    q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+    q.b0  = weight * n.x * d;   q.b1  = weight * n.y * d;   q.b2  = weight * n.z * d;
+    q.c   = weight * d * d;
+    q.w   = weight;
+    return q;
+  }
+
+  auto& operator+=(Quadric const& q)
+  {
+    a00 += q.a00; a01 += q.a01; a02 += q.a02;
+    a11 += q.a11; a12 += q.a12; a22 += q.a22;
+    b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+    c   += q.c;
+    w   += q.w;
+    return *this;
+  }
+
+  auto error(glm::vec3 p) const
+  {
+    double x = p.x, y = p.y, z = p.z;
+    auto e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z +
+             a11 * y * y + 2 * a12 * y * z + a22 * z * z     +
+             2 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(e, 0.) / std::max(w, 1e-12);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Simplify
+////////////////////////////////////////////////////////////////////////////////
+
+auto simplify(std::span<Vertex const> vertices, std::span<uint32_t const> indices, uint32_t target_triangle_count, float& error) -> std::vector<uint32_t>
+{
+  std::vector<uint32_t> result(indices.begin(), indices.end());
+  error = 0.f;
+
+  //
+  // canonical id of position, vertices with same position are wedges of it
+  //
+  std::unordered_map<std::string_view, uint32_t> unique;
+  std::vector<uint32_t>              pos_id(vertices.size());
+  std::vector<std::vector<uint32_t>> wedges;
+  std::vector<glm::vec3>             positions;
+  for (uint32_t v = 0; v < vertices.size(); ++v)
+  {
+    auto key = std::string_view(reinterpret_cast<char const*>(&vertices[v].pos), sizeof(glm::vec3));
+    auto [it, inserted] = unique.try_emplace(key, (uint32_t)wedges.size());
+    if (inserted)
+    {
+      wedges.emplace_back();
+      positions.push_back(vertices[v].pos);
+    }
+    pos_id[v] = it->second;
+    wedges[it->second].push_back(v);
+  }
+  auto count = (uint32_t)wedges.size();
+
+  //
+  // quadrics from triangle planes, lock border and non manifold edges
+  //
+  std::vector<Quadric> quadrics(count);
+  std::vector<bool>    locked(count, false);
+  {
+    std::unordered_map<uint64_t, uint32_t> edges;
+    for (uint32_t t = 0; t < result.size() / 3; ++t)
+    {
+      uint32_t c[3] = { pos_id[result[t * 3]], pos_id[result[t * 3 + 1]], pos_id[result[t * 3 + 2]] };
+      auto n    = glm::cross(positions[c[1]] - positions[c[0]], positions[c[2]] - positions[c[0]]);
+      auto area = glm::length(n);
+      if (area > 0.f)
+      {
+        n /= area;
+        auto q = Quadric::from_plane(n, -glm::dot(n, positions[c[0]]), area * .5f);
+        for (auto id : c)
+          quadrics[id] += q;
+      }
+      for (uint32_t k = 0; k < 3; ++k)
+      {
+        auto a = c[k], b = c[(k + 1) % 3];
+        ++edges[(uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+      }
+    }
+    for (auto [edge, n] : edges)
+    {
+      if (n == 2)
+        continue;
+      locked[edge >> 32]        = true;
+      locked[edge & 0xffffffff] = true;
+    }
+  }
+
+  struct Collapse
+  {
+    uint32_t from;
+    uint32_t to;
+    double   cost;
+  };
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> offsets, adjacency;
+  std::vector<uint32_t> collapse_to(vertices.size());
+  std::vector<bool>     touched(count);
+
+  auto triangle_count = (uint32_t)result.size() / 3;
+  while (triangle_count > target_triangle_count)
+  {
+    //
+    // position to triangles adjacency in CSR
+    //
+    offsets.assign(count + 1, 0);
+    for (auto v : result)
+      ++offsets[pos_id[v] + 1];
+    for (uint32_t i = 0; i < count; ++i)
+      offsets[i + 1] += offsets[i];
+    adjacency.resize(result.size());
+    {
+      auto fill = std::vector<uint32_t>(offsets.begin(), offsets.end() - 1);
+      for (uint32_t i = 0; i < result.size(); ++i)
+        adjacency[fill[pos_id[result[i]]]++] = i / 3;
+    }
+
+    //
+    // candidates of every edge in both directions, cheap first
+    //
+    collapses.clear();
+    for (uint32_t t = 0; t < triangle_count; ++t)
+      for (uint32_t k = 0; k < 3; ++k)
+      {
+        auto a = pos_id[result[t * 3 + k]];
+        auto b = pos_id[result[t * 3 + (k + 1) % 3]];
+        if (a > b)
+          continue;
+        auto q = quadrics[a];
+        q += quadrics[b];
+        if (!locked[a])
+          collapses.emplace_back(a, b, q.error(positions[b]));
+        if (!locked[b])
+          collapses.emplace_back(b, a, q.error(positions[a]));
+      }
+    std::sort(collapses.begin(), collapses.end(), [](auto const& x, auto const& y) { return x.cost < y.cost; });
+
+    //
+    // collapse greedily, positions around a collapse are not touched again in this pass
+    //
+    for (uint32_t v = 0; v < vertices.size(); ++v)
+      collapse_to[v] = v;
+    touched.assign(count, false);
+    uint32_t remain   = triangle_count;
+    bool     progress = false;
+    for (auto const& [a, b, cost] : collapses)
+    {
+      if (remain <= target_triangle_count)
+        break;
+      if (touched[a] || touched[b])
+        continue;
+
+      // reject collapse flips triangles around a
+      bool     valid   = true;
+      uint32_t removed = 0;
+      for (auto i = offsets[a]; i < offsets[a + 1] && valid; ++i)
+      {
+        auto t = adjacency[i];
+        uint32_t c[3] = { pos_id[result[t * 3]], pos_id[result[t * 3 + 1]], pos_id[result[t * 3 + 2]] };
+        if (c[0] == b || c[1] == b || c[2] == b)
+        {
+          ++removed;
+          continue;
+        }
+        glm::vec3 p[3] = { positions[c[0]], positions[c[1]], positions[c[2]] };
+        auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (uint32_t k = 0; k < 3; ++k)
+          if (c[k] == a)
+            p[k] = positions[b];
+        auto after = glm::cross(p[1] - p[0], p[2] - p[0]);
+        valid = glm::dot(before, after) > 0.f;
+      }
+      if (!valid)
+        continue;
+
+      // move wedges of a to wedge of b which has closest normal
+      for (auto v : wedges[a])
+      {
+        auto best  = wedges[b].front();
+        auto score = -2.f;
+        for (auto w : wedges[b])
+        {
+          auto s = glm::dot(vertices[v].normal, vertices[w].normal);
+          if (s > score)
+          {
+            score = s;
+            best  = w;
+          }
+        }
+        collapse_to[v] = best;
+      }
+      quadrics[b] += quadrics[a];
+
+      touched[a] = touched[b] = true;
+      for (auto i = offsets[a]; i < offsets[a + 1]; ++i)
+        for (uint32_t k = 0; k < 3; ++k)
+          touched[pos_id[result[adjacency[i] * 3 + k]]] = true;
+
+      remain  -= std::min(removed, remain);
+      error    = std::max(error, (float)cost);
+      progress = true;
+    }
+    if (!progress)
+      break;
+
+    //
+    // apply collapses and remove degenerate triangles
+    //
+    uint32_t write = 0;
+    for (uint32_t t = 0; t < triangle_count; ++t)
+    {
+      uint32_t v[3] = { collapse_to[result[t * 3]], collapse_to[result[t * 3 + 1]], collapse_to[result[t * 3 + 2]] };
+      if (pos_id[v[0]] == pos_id[v[1]] || pos_id[v[1]] == pos_id[v[2]] || pos_id[v[0]] == pos_id[v[2]])
+        continue;
+      result[write++] = v[0];
+      result[write++] = v[1];
+      result[write++] = v[2];
+    }
+    result.resize(write);
+    triangle_count = write / 3;
+  }
+
+  error = std::sqrt(error);
+  return result;
+}
+
+void generate_lods(std::span<Vertex const> vertices, std::vector<uint32_t>& indices, std::span<GeometrySurface> surfaces)
+{
+  for (auto& surface : surfaces)
+  {
+    surface.lods[0]   = { surface.start_index, surface.count, 0.f };
+    surface.lod_count = 1;
+
+    auto  source = std::vector<uint32_t>(indices.begin() + surface.start_index, indices.begin() + surface.start_index + surface.count);
+    float error  = 0.f;
+    while (surface.lod_count < Max_Lod_Count)
+    {
+      auto target = (uint32_t)source.size() / 3 / 2;
+      if (target < Min_Lod_Triangle_Count)
+        break;
+
+      float lod_error;
+      auto  lod = simplify(vertices, source, target, lod_error);
+      if (lod.size() > source.size() * Min_Lod_Reduction)
+        break;
+      optimize_vertex_cache(lod, vertices.size());
+
+      // simplified from previous lod, so deviation from full detail is bounded by sum
+      error += lod_error;
+      surface.lods[surface.lod_count++] = { (uint32_t)indices.size(), (uint32_t)lod.size(), error };
+      indices.insert(indices.end(), lod.begin(), lod.end());
+      source = std::move(lod);
+    }
+  }
+}
+
+} }
@@ -0,0 +1,127 @@
+#include "MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tk { namespace graphics_engine {
+
+static auto compute_meshlet_bounds(std::span<Vertex const> vertices, std::span<uint32_t const> indices) -> Meshlet
+{
+  Meshlet meshlet = {};
+
+  //
+  // sphere centered at bounding box center
+  //
+  auto min = vertices[indices[0]].pos;
+  auto max = min;
+  for (auto idx : indices)
+  {
+    min = glm::min(min, vertices[idx].pos);
+    max = glm::max(max, vertices[idx].pos);
+  }
+  auto  center = (min + max) * .5f;
+  float radius = 0.f;
+  for (auto idx : indices)
+    radius = std::max(radius, glm::length(vertices[idx].pos - center));
+  meshlet.sphere = glm::vec4(center, radius);
+
+  //
+  // cone axis is average of triangle normals, cutoff is sine of spread angle,
+  // cone is disabled when triangles face to more than about 90 degrees
+  //
+  auto axis = glm::vec3(0.f);
+  for (uint32_t t = 0; t < indices.size(); t += 3)
+  {
+    auto& p0 = vertices[indices[t + 0]].pos;
+    auto& p1 = vertices[indices[t + 1]].pos;
+    auto& p2 = vertices[indices[t + 2]].pos;
+    auto  n  = glm::cross(p1 - p0, p2 - p0);
+    auto  l  = glm::length(n);
+    if (l > 0.f)
+      axis += n / l;
+  }
+  auto axis_length = glm::length(axis);
+  meshlet.cone = glm::vec4(0.f, 0.f, 0.f, 2.f);
+  if (axis_length == 0.f)
+    return meshlet;
+  axis /= axis_length;
+
+  float min_dot = 1.f;
+  for (uint32_t t = 0; t < indices.size(); t += 3)
+  {
+    auto& p0 = vertices[indices[t + 0]].pos;
+    auto& p1 = vertices[indices[t + 1]].pos;
+    auto& p2 = vertices[indices[t + 2]].pos;
+    auto  n  = glm::cross(p1 - p0, p2 - p0);
+    auto  l  = glm::length(n);
+    if (l > 0.f)
+      min_dot = std::min(min_dot, glm::dot(axis, n / l));
+  }
+  if (min_dot > .1f)
+    meshlet.cone = glm::vec4(axis, std::sqrt(1.f - min_dot * min_dot));
+
+  return meshlet;
+}
+
+void build_meshlets(std::span<Vertex const> vertices, std::span<uint32_t const> indices,
+                    uint32_t start_index, uint32_t count, std::vector<Meshlet>& meshlets)
+{
+  // last meshlet which used the vertex, so unique vertices are counted without set
+  std::vector<uint32_t> used(vertices.size(), ~0u);
+  uint32_t meshlet_id     = 0;
+  uint32_t begin          = start_index;
+  uint32_t vertex_count   = 0;
+  uint32_t triangle_count = 0;
+
+  auto flush = [&](uint32_t end)
+  {
+    if (end == begin)
+      return;
+    auto meshlet           = compute_meshlet_bounds(vertices, indices.subspan(begin, end - begin));
+    meshlet.start_index    = begin;
+    meshlet.triangle_count = (end - begin) / 3;
+    meshlets.push_back(meshlet);
+    begin          = end;
+    vertex_count   = 0;
+    triangle_count = 0;
+    ++meshlet_id;
+  };
+
+  for (auto t = start_index; t < start_index + count; t += 3)
+  {
+    uint32_t new_vertices = 0;
+    for (uint32_t k = 0; k < 3; ++k)
+      if (used[indices[t + k]] != meshlet_id)
+        ++new_vertices;
+    // new vertices may be counted twice for degenerate triangle, it's fine to be conservative
+    if (vertex_count + new_vertices > Meshlet_Max_Vertices || triangle_count + 1 > Meshlet_Max_Triangles)
+      flush(t);
+
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+      auto v = indices[t + k];
+      if (used[v] != meshlet_id)
+      {
+        used[v] = meshlet_id;
+        ++vertex_count;
+      }
+    }
+    ++triangle_count;
+  }
+  flush(start_index + count);
+}
+
+void build_meshlets(std::span<Vertex const> vertices, std::span<uint32_t const> indices,
+                    std::span<GeometrySurface> surfaces, std::vector<Meshlet>& meshlets)
+{
+  for (auto& surface : surfaces)
+    for (uint32_t i = 0; i < surface.lod_count; ++i)
+    {
+      auto& lod          = surface.lods[i];
+      lod.meshlet_offset = meshlets.size();
+      build_meshlets(vertices, indices, lod.start_index, lod.count, meshlets);
+      lod.meshlet_count  = meshlets.size() - lod.meshlet_offset;
+    }
+}
+
+} }
@@ -1,10 +1,139 @@
 #include "PipelineBuilder.hpp"
 #include "ErrorHandling.hpp"
 
+#include <array>
+#include <functional>
+
 namespace tk { namespace graphics_engine {
 
+auto PipelineKey::Hash::operator()(PipelineKey const& key) const noexcept -> size_t
+{
+  size_t hash    = 0;
+  auto   combine = [&](uint64_t value) { hash ^= std::hash<uint64_t>{}(value) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2); };
+  combine((uint64_t)key.layout);
+  combine((uint64_t)key.vertex_shader);
+  combine((uint64_t)key.fragment_shader);
+  combine((uint64_t)key.compute_shader);
+  for (uint32_t i = 0; i < key.constant_count; ++i)
+    combine((uint64_t)key.constants[i].id << 32 | key.constants[i].value);
+  for (uint64_t value : { (uint64_t)key.color_format,     (uint64_t)key.depth_format,
+                          (uint64_t)key.cull_mode,        (uint64_t)key.front_face,
+                          (uint64_t)key.depth_test,       (uint64_t)key.depth_write,       (uint64_t)key.depth_compare,
+                          (uint64_t)key.blend_enable,
+                          (uint64_t)key.src_color_factor, (uint64_t)key.dst_color_factor,  (uint64_t)key.color_blend_op,
+                          (uint64_t)key.src_alpha_factor, (uint64_t)key.dst_alpha_factor,  (uint64_t)key.alpha_blend_op,
+                          (uint64_t)key.color_write_mask,
+                          (uint64_t)key.dynamic_depth_cull, (uint64_t)key.dynamic_blend })
+    combine(value);
+  return hash;
+}
+
+auto PipelineKey::get_base() const -> PipelineKey
+{
+  auto base     = *this;
+  auto defaults = PipelineKey{};
+  if (dynamic_depth_cull)
+  {
+    base.cull_mode     = defaults.cull_mode;
+    base.front_face    = defaults.front_face;
+    base.depth_test    = defaults.depth_test;
+    base.depth_write   = defaults.depth_write;
+    base.depth_compare = defaults.depth_compare;
+  }
+  if (dynamic_blend)
+  {
+    base.blend_enable     = defaults.blend_enable;
+    base.src_color_factor = defaults.src_color_factor;
+    base.dst_color_factor = defaults.dst_color_factor;
+    base.color_blend_op   = defaults.color_blend_op;
+    base.src_alpha_factor = defaults.src_alpha_factor;
+    base.dst_alpha_factor = defaults.dst_alpha_factor;
+    base.alpha_blend_op   = defaults.alpha_blend_op;
+    base.color_write_mask = defaults.color_write_mask;
+  }
+  return base;
+}
+
 auto PipelineBuilder::build(VkDevice device, VkPipelineLayout layout) -> VkPipeline
 {
+  return build(device, get_key(layout));
+}
+
+auto PipelineBuilder::get_key(VkPipelineLayout layout) const -> PipelineKey
+{
+  auto key   = _key;
+  key.layout = layout;
+  return key;
+}
+
+auto PipelineBuilder::build(VkDevice device, PipelineKey const& key, VkPipelineCache cache) -> VkPipeline
+{
+  // constants not used by a stage are ignored
+  std::array<VkSpecializationMapEntry, PipelineKey::Max_Constants> map_entries;
+  for (uint32_t i = 0; i < key.constant_count; ++i)
+    map_entries[i] =
+    {
+      .constantID = key.constants[i].id,
+      .offset     = (uint32_t)(i * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value)),
+      .size       = sizeof(uint32_t),
+    };
+  VkSpecializationInfo specialization
+  {
+    .mapEntryCount = key.constant_count,
+    .pMapEntries   = map_entries.data(),
+    .dataSize      = key.constant_count * sizeof(SpecializationConstant),
+    .pData         = key.constants.data(),
+  };
+  auto specialization_info = key.constant_count ? &specialization : nullptr;
+
+  VkPipeline pipeline;
+  if (key.compute_shader)
+  {
+    VkComputePipelineCreateInfo info
+    {
+      .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage  =
+      {
+        .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage               = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module              = key.compute_shader,
+        .pName               = "main",
+        .pSpecializationInfo = specialization_info,
+      },
+      .layout = key.layout,
+    };
+    throw_if(vkCreateComputePipelines(device, cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS,
+             "failed to create compute pipeline");
+    return pipeline;
+  }
+
+  std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages
+  {{
+    {
+      .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage               = VK_SHADER_STAGE_VERTEX_BIT,
+      .module              = key.vertex_shader,
+      .pName               = "main",
+      .pSpecializationInfo = specialization_info,
+    },
+    {
+      .sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage               = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module              = key.fragment_shader,
+      .pName               = "main",
+      .pSpecializationInfo = specialization_info,
+    },
+  }};
+
+  // use dynamic rendering
+  VkPipelineRenderingCreateInfo rendering_info
+  {
+    .sType                   = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+    .colorAttachmentCount    = key.color_format != VK_FORMAT_UNDEFINED ? 1u : 0u,
+    .pColorAttachmentFormats = &key.color_format,
+    .depthAttachmentFormat   = key.depth_format,
+  };
+
   // HACK: can be nullptr for dynamic rendering, see spec
   VkPipelineVertexInputStateCreateInfo vertex_input_state
   {
@@ -28,8 +157,23 @@ auto PipelineBuilder::build(VkDevice device, VkPipelineLayout layout) -> VkPipel
 
   // HACK: should be discard because of dynamic rendering, see spec
   // set rasterization default option
-  _rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
-  _rasterization_state.lineWidth   = 1.f; 
+  VkPipelineRasterizationStateCreateInfo rasterization_state
+  {
+    .sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+    .polygonMode = VK_POLYGON_MODE_FILL,
+    .cullMode    = key.cull_mode,
+    .frontFace   = key.front_face,
+    .lineWidth   = 1.f,
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil_state
+  {
+    .sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+    .depthTestEnable  = key.depth_test,
+    .depthWriteEnable = key.depth_write,
+    .depthCompareOp   = key.depth_compare,
+    .maxDepthBounds   = 1.f,
+  };
 
   // TODO: use it in feature and it can be dynamic rendering, default multisample option
   VkPipelineMultisampleStateCreateInfo multisample_state
@@ -39,37 +183,61 @@ auto PipelineBuilder::build(VkDevice device, VkPipelineLayout layout) -> VkPipel
     .minSampleShading     = 1.f,
   };
 
+  VkPipelineColorBlendAttachmentState color_blend_attachment
+  {
+    .blendEnable         = key.blend_enable,
+    .srcColorBlendFactor = key.src_color_factor,
+    .dstColorBlendFactor = key.dst_color_factor,
+    .colorBlendOp        = key.color_blend_op,
+    .srcAlphaBlendFactor = key.src_alpha_factor,
+    .dstAlphaBlendFactor = key.dst_alpha_factor,
+    .alphaBlendOp        = key.alpha_blend_op,
+    .colorWriteMask      = key.color_write_mask,
+  };
+
   // HACK: can be nullptr for dynamic rendering, see spec
   VkPipelineColorBlendStateCreateInfo color_blend_state
   { 
     .sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
     .logicOp         = VK_LOGIC_OP_COPY,
-    .attachmentCount = 1,
-    .pAttachments    = &_color_blend_attachment,
+    .attachmentCount = rendering_info.colorAttachmentCount,
+    .pAttachments    = &color_blend_attachment,
   };
 
   // dynamic config
-  auto dynamics = std::vector<VkDynamicState>
+  auto dynamics      = std::array<VkDynamicState, 10>
   {
     VK_DYNAMIC_STATE_VIEWPORT,
     VK_DYNAMIC_STATE_SCISSOR,
   };
+  auto dynamic_count = 2u;
+  if (key.dynamic_depth_cull)
+    for (auto state : { VK_DYNAMIC_STATE_CULL_MODE,
+                        VK_DYNAMIC_STATE_FRONT_FACE,
+                        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+                        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+                        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP })
+      dynamics[dynamic_count++] = state;
+  if (key.dynamic_blend)
+    for (auto state : { VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+                        VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
+                        VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT })
+      dynamics[dynamic_count++] = state;
   VkPipelineDynamicStateCreateInfo dynamic_state
   {
     .sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-    .dynamicStateCount = (uint32_t)dynamics.size(),
+    .dynamicStateCount = dynamic_count,
     .pDynamicStates    = dynamics.data(),
   };
 
   // create pipeline
-  VkPipeline pipeline;
   VkGraphicsPipelineCreateInfo info
   {
     .sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
     // use dynamic rendering
-    .pNext               = &_rendering_info,
-    .stageCount          = (uint32_t)_shader_stages.size(),
-    .pStages             = _shader_stages.data(),
+    .pNext               = &rendering_info,
+    .stageCount          = (uint32_t)shader_stages.size(),
+    .pStages             = shader_stages.data(),
     // HACK: can be nullptr for dynamic rendering, see spec
     .pVertexInputState   = &vertex_input_state,
     // HACK: can be nullptr for dynamic rendering, see spec
@@ -79,104 +247,108 @@ auto PipelineBuilder::build(VkDevice device, VkPipelineLayout layout) -> VkPipel
     // HACK: can be nullptr for dynamic rendering, see spec
     .pViewportState      = &viewport_state,
     // HACK: can be nullptr for dynamic rendering, see spec
-    .pRasterizationState = &_rasterization_state,
+    .pRasterizationState = &rasterization_state,
     // HACK: can be nullptr for dynamic rendering, see spec
     .pMultisampleState   = &multisample_state,
     // HACK: can be dynamic rendering
-    .pDepthStencilState  = &_depth_stencil_state,
+    .pDepthStencilState  = &depth_stencil_state,
     // HACK: can be nullptr for dynamic rendering, see spec
     .pColorBlendState    = &color_blend_state,
     .pDynamicState       = &dynamic_state,
-    .layout              = layout,
+    .layout              = key.layout,
   };
-  throw_if(vkCreateGraphicsPipelines(device, nullptr, 1, &info, nullptr, &pipeline) != VK_SUCCESS,
+  throw_if(vkCreateGraphicsPipelines(device, cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS,
            "failed to create pipeline");
   return pipeline;
 }
 
 auto PipelineBuilder::clear() -> PipelineBuilder&
 {
-  _shader_stages.clear();
-  _rendering_info         = { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO           };
-  _rasterization_state    = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
-  _depth_stencil_state    = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-  _rendering_info_format  = { VK_FORMAT_UNDEFINED };
-  _color_blend_attachment =
-  {
-    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-                      VK_COLOR_COMPONENT_G_BIT |
-                      VK_COLOR_COMPONENT_B_BIT |
-                      VK_COLOR_COMPONENT_A_BIT,
-  };
+  _key = {};
   return *this;
 }
 
 auto PipelineBuilder::set_color_attachment_format(VkFormat format) -> PipelineBuilder&
 {
-  _rendering_info_format = format;
-  _rendering_info.colorAttachmentCount    = 1;
-  _rendering_info.pColorAttachmentFormats = &_rendering_info_format;
+  _key.color_format = format;
   return *this;
 }
 
 auto PipelineBuilder::set_shaders(VkShaderModule vertex_shader, VkShaderModule fragment_shader) -> PipelineBuilder&
 {
-  _shader_stages =
-  {
-    {
-      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage  = VK_SHADER_STAGE_VERTEX_BIT,
-      .module = vertex_shader,
-      .pName = "main",
-    },
+  _key.vertex_shader   = vertex_shader;
+  _key.fragment_shader = fragment_shader;
+  return *this;
+}
+
+auto PipelineBuilder::set_compute_shader(VkShaderModule shader) -> PipelineBuilder&
+{
+  _key.compute_shader = shader;
+  return *this;
+}
+
+auto PipelineBuilder::set_constant(uint32_t id, uint32_t value) -> PipelineBuilder&
+{
+  for (uint32_t i = 0; i < _key.constant_count; ++i)
+    if (_key.constants[i].id == id)
     {
-      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
-      .module = fragment_shader,
-      .pName = "main",
-    },
-  };
+      _key.constants[i].value = value;
+      return *this;
+    }
+  throw_if(_key.constant_count == PipelineKey::Max_Constants, "too many specialization constants");
+  _key.constants[_key.constant_count++] = { id, value };
   return *this;
 }
 
 auto PipelineBuilder::set_cull_mode(VkCullModeFlags cull_mode, VkFrontFace front_face) -> PipelineBuilder&
 {
-  _rasterization_state.cullMode  = cull_mode;
-  _rasterization_state.frontFace = front_face;
+  _key.cull_mode  = cull_mode;
+  _key.front_face = front_face;
   return *this;
 }
 
 auto PipelineBuilder::enable_depth_test(VkFormat format) -> PipelineBuilder&
 {
-  _rendering_info.depthAttachmentFormat = format;
-  _depth_stencil_state.depthTestEnable  = VK_TRUE;
-  _depth_stencil_state.depthWriteEnable = VK_TRUE;
-  _depth_stencil_state.depthCompareOp   = VK_COMPARE_OP_GREATER_OR_EQUAL;
-  _depth_stencil_state.maxDepthBounds   = 1.f;
+  _key.depth_format  = format;
+  _key.depth_test    = VK_TRUE;
+  _key.depth_write   = VK_TRUE;
+  _key.depth_compare = VK_COMPARE_OP_GREATER_OR_EQUAL;
   return *this;
 }
 
 auto PipelineBuilder::enable_additive_blending() -> PipelineBuilder&
 {
-  _color_blend_attachment.blendEnable = VK_TRUE;
-  _color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-  _color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
-  _color_blend_attachment.colorBlendOp        = VK_BLEND_OP_ADD;
-  _color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-  _color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-  _color_blend_attachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+  _key.blend_enable     = VK_TRUE;
+  _key.src_color_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+  _key.dst_color_factor = VK_BLEND_FACTOR_ONE;
+  _key.color_blend_op   = VK_BLEND_OP_ADD;
+  _key.src_alpha_factor = VK_BLEND_FACTOR_ONE;
+  _key.dst_alpha_factor = VK_BLEND_FACTOR_ZERO;
+  _key.alpha_blend_op   = VK_BLEND_OP_ADD;
   return *this;
 }
 
 auto PipelineBuilder::enable_alpha_blending() -> PipelineBuilder&
 {
-  _color_blend_attachment.blendEnable = VK_TRUE;
-  _color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR;
-  _color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
-  _color_blend_attachment.colorBlendOp        = VK_BLEND_OP_ADD;
-  _color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-  _color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-  _color_blend_attachment.alphaBlendOp        = VK_BLEND_OP_ADD;
+  _key.blend_enable     = VK_TRUE;
+  _key.src_color_factor = VK_BLEND_FACTOR_SRC_COLOR;
+  _key.dst_color_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+  _key.color_blend_op   = VK_BLEND_OP_ADD;
+  _key.src_alpha_factor = VK_BLEND_FACTOR_ONE;
+  _key.dst_alpha_factor = VK_BLEND_FACTOR_ZERO;
+  _key.alpha_blend_op   = VK_BLEND_OP_ADD;
+  return *this;
+}
+
+auto PipelineBuilder::enable_dynamic_depth_cull() -> PipelineBuilder&
+{
+  _key.dynamic_depth_cull = VK_TRUE;
+  return *this;
+}
+
+auto PipelineBuilder::enable_dynamic_blend() -> PipelineBuilder&
+{
+  _key.dynamic_blend = VK_TRUE;
   return *this;
 }
 
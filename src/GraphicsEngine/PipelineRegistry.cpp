@@ -0,0 +1,152 @@
+#include "PipelineRegistry.hpp"
+#include "ErrorHandling.hpp"
+#include "HeapGuard.hpp"
+#include "Log.hpp"
+
+#include <chrono>
+
+namespace tk { namespace graphics_engine {
+
+void PipelineRegistry::init(VkDevice device, std::filesystem::path const& shader_pack, bool dynamic_blend_supported)
+{
+  _device                  = device;
+  _shader_pack             = ShaderPack(shader_pack);
+  _dynamic_blend_supported = dynamic_blend_supported;
+  if (_dynamic_blend_supported)
+  {
+    _vkCmdSetColorBlendEnableEXT   = (PFN_vkCmdSetColorBlendEnableEXT)vkGetDeviceProcAddr(_device, "vkCmdSetColorBlendEnableEXT");
+    _vkCmdSetColorBlendEquationEXT = (PFN_vkCmdSetColorBlendEquationEXT)vkGetDeviceProcAddr(_device, "vkCmdSetColorBlendEquationEXT");
+    _vkCmdSetColorWriteMaskEXT     = (PFN_vkCmdSetColorWriteMaskEXT)vkGetDeviceProcAddr(_device, "vkCmdSetColorWriteMaskEXT");
+  }
+
+  VkPipelineCacheCreateInfo info
+  {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+  };
+  throw_if(vkCreatePipelineCache(_device, &info, nullptr, &_cache) != VK_SUCCESS,
+           "failed to create pipeline cache");
+}
+
+void PipelineRegistry::destroy()
+{
+  for (auto& [key, entry] : _pipelines)
+  {
+    take_pending(entry);
+    vkDestroyPipeline(_device, entry.pipeline, nullptr);
+  }
+  for (auto& [name, shader] : _shaders)
+    vkDestroyShaderModule(_device, shader, nullptr);
+  vkDestroyPipelineCache(_device, _cache, nullptr);
+  _pipelines.clear();
+  _shaders.clear();
+  _shader_pack = {};
+}
+
+auto PipelineRegistry::get_shader(std::string const& name) -> VkShaderModule
+{
+  if (auto it = _shaders.find(name); it != _shaders.end())
+    return it->second;
+
+  // code is read from mapped pack directly
+  auto code = _shader_pack.get(name);
+  VkShaderModuleCreateInfo info
+  {
+    .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+    .codeSize = code.size_bytes(),
+    .pCode    = code.data(),
+  };
+  VkShaderModule shader;
+  throw_if(vkCreateShaderModule(_device, &info, nullptr, &shader) != VK_SUCCESS,
+           "failed to create shader {}", name);
+  _shaders.emplace(name, shader);
+  return shader;
+}
+
+auto PipelineRegistry::get_base(PipelineKey key) const -> PipelineKey
+{
+  if (!_dynamic_blend_supported)
+    key.dynamic_blend = VK_FALSE;
+  return key.get_base();
+}
+
+//
+// compile error of worker is logged and pipeline is left null,
+// so get() keeps returning fallback and build() reports error by compiling again.
+//
+void PipelineRegistry::take_pending(Entry& entry)
+{
+  if (!entry.pending.valid())
+    return;
+  try
+  {
+    entry.pipeline = entry.pending.get();
+  }
+  catch (std::exception const& e)
+  {
+    auto allow_heap = AllowHeapScope();
+    log::error("failed to compile pipeline: {}", e.what());
+  }
+}
+
+auto PipelineRegistry::build(PipelineKey const& key) -> VkPipeline
+{
+  auto  base  = get_base(key);
+  auto& entry = _pipelines[base];
+  take_pending(entry);
+  if (entry.pipeline == VK_NULL_HANDLE)
+    entry.pipeline = PipelineBuilder::build(_device, base, _cache);
+  return entry.pipeline;
+}
+
+auto PipelineRegistry::get(PipelineKey const& key, VkPipeline fallback) -> VkPipeline
+{
+  auto base = get_base(key);
+  auto it   = _pipelines.find(base);
+  if (it == _pipelines.end())
+  {
+    // only key is copied to thread, device and cache can be used on any thread
+    auto allow_heap = AllowHeapScope();
+    it = _pipelines.emplace(base, Entry
+    {
+      .pending = std::async(std::launch::async, [device = _device, cache = _cache, base]
+      {
+        return PipelineBuilder::build(device, base, cache);
+      }),
+    }).first;
+  }
+
+  auto& entry = it->second;
+  if (entry.pending.valid() && entry.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return fallback;
+  take_pending(entry);
+  return entry.pipeline != VK_NULL_HANDLE ? entry.pipeline : fallback;
+}
+
+void PipelineRegistry::set_dynamic_state(VkCommandBuffer cmd, PipelineKey const& key) const
+{
+  if (key.dynamic_depth_cull)
+  {
+    vkCmdSetCullMode(cmd, key.cull_mode);
+    vkCmdSetFrontFace(cmd, key.front_face);
+    vkCmdSetDepthTestEnable(cmd, key.depth_test);
+    vkCmdSetDepthWriteEnable(cmd, key.depth_write);
+    vkCmdSetDepthCompareOp(cmd, key.depth_compare);
+  }
+  if (key.dynamic_blend && _dynamic_blend_supported)
+  {
+    VkColorBlendEquationEXT equation
+    {
+      .srcColorBlendFactor = key.src_color_factor,
+      .dstColorBlendFactor = key.dst_color_factor,
+      .colorBlendOp        = key.color_blend_op,
+      .srcAlphaBlendFactor = key.src_alpha_factor,
+      .dstAlphaBlendFactor = key.dst_alpha_factor,
+      .alphaBlendOp        = key.alpha_blend_op,
+    };
+    _vkCmdSetColorBlendEnableEXT(cmd, 0, 1, &key.blend_enable);
+    _vkCmdSetColorBlendEquationEXT(cmd, 0, 1, &equation);
+    _vkCmdSetColorWriteMaskEXT(cmd, 0, 1, &key.color_write_mask);
+  }
+}
+
+} }
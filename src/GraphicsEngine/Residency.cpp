@@ -0,0 +1,150 @@
+#include "Residency.hpp"
+#include "constant.hpp"
+#include "Log.hpp"
+#include "HeapGuard.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace tk { namespace graphics_engine {
+
+void Residency::track(std::shared_ptr<MeshAsset> const& mesh)
+{
+  mesh->last_used = _frame;
+  _meshs.emplace_back(mesh);
+}
+
+void Residency::track(std::shared_ptr<Texture> const& texture)
+{
+  texture->last_used = _frame;
+  _textures.emplace_back(texture);
+}
+
+auto Residency::update(VmaAllocator allocator) -> std::vector<std::shared_ptr<Texture>>
+{
+  ++_frame;
+  std::erase_if(_textures, [](auto const& texture) { return texture.expired(); });
+
+  // released memory is freed after frames in flight finished,
+  // wait it reflected in budget before evicting more
+  if (_frame < _cooldown_end)
+    return {};
+
+  VkPhysicalDeviceMemoryProperties const* memory_properties;
+  vmaGetMemoryProperties(allocator, &memory_properties);
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+  vmaGetHeapBudgets(allocator, budgets.data());
+
+  // bytes to release of each heap
+  std::array<int64_t, VK_MAX_MEMORY_HEAPS> excess = {};
+  auto over = false;
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i)
+  {
+    if (budgets[i].usage <= budgets[i].budget * Residency_High_Watermark)
+      continue;
+    excess[i] = budgets[i].usage - budgets[i].budget * Residency_Low_Watermark;
+    over      = true;
+  }
+  if (!over)
+    return {};
+
+  // eviction is rare, candidates are collected to vectors
+  auto allow_heap = AllowHeapScope();
+
+  struct Usage
+  {
+    uint32_t     heap;
+    VkDeviceSize size;
+  };
+  auto get_usage = [&](VmaAllocation allocation)
+  {
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator, allocation, &info);
+    return Usage{ memory_properties->memoryTypes[info.memoryType].heapIndex, info.size };
+  };
+
+  //
+  // meshs only retained by residency, least recently used first
+  //
+  auto mesh_count = _meshs.size();
+  std::ranges::sort(_meshs, {}, [](auto const& mesh) { return mesh->last_used; });
+  std::erase_if(_meshs, [&](auto const& mesh)
+  {
+    if (mesh.use_count() > 1)
+      return false;
+
+    auto usages = std::vector<Usage>();
+    for (auto allocation : { mesh->mesh_buffer.vertices.allocation,
+                             mesh->mesh_buffer.indices.allocation,
+                             mesh->mesh_buffer.meshlets.allocation })
+      if (allocation != VK_NULL_HANDLE)
+        usages.emplace_back(get_usage(allocation));
+    if (std::ranges::none_of(usages, [&](auto const& usage) { return excess[usage.heap] > 0; }))
+      return false;
+
+    for (auto const& usage : usages)
+      excess[usage.heap] -= usage.size;
+    return true;
+  });
+  mesh_count -= _meshs.size();
+
+  //
+  // cold textures, top mip is about three quarters of texture
+  //
+  auto textures = std::vector<std::shared_ptr<Texture>>();
+  for (auto const& weak : _textures)
+  {
+    // textures can be released by meshs evicted above
+    auto texture = weak.lock();
+    if (!texture)
+      continue;
+    auto extent  = texture->image.extent;
+    if (_frame - texture->last_used >= Residency_Cold_Frames &&
+        texture->resident_mip == 0 && texture->data.empty()  &&
+        std::max(extent.width, extent.height) > Texture_Preview_Size)
+      textures.emplace_back(std::move(texture));
+  }
+  std::ranges::sort(textures, {}, [](auto const& texture) { return texture->last_used; });
+  std::erase_if(textures, [&](auto const& texture)
+  {
+    auto usage = get_usage(texture->image.allocation);
+    if (excess[usage.heap] <= 0)
+      return true;
+    excess[usage.heap] -= usage.size * 3 / 4;
+    return false;
+  });
+
+  if (mesh_count > 0 || !textures.empty())
+  {
+    log::info("residency: over budget, evicted {} meshs, demoted {} textures", mesh_count, textures.size());
+    _cooldown_end = _frame + Max_Frame_Number + 1;
+  }
+  return textures;
+}
+
+auto Residency::take_promotions() -> std::vector<std::shared_ptr<Texture>>
+{
+  auto textures = std::vector<std::shared_ptr<Texture>>();
+  for (auto const& weak : _textures)
+  {
+    auto texture = weak.lock();
+    if (!texture || !texture->demoted || _frame - texture->last_used >= Residency_Cold_Frames)
+      continue;
+    texture->demoted = false;
+    textures.emplace_back(std::move(texture));
+  }
+  return textures;
+}
+
+auto Residency::release_retained() -> uint32_t
+{
+  return std::erase_if(_meshs, [](auto const& mesh) { return mesh.use_count() == 1; });
+}
+
+void Residency::clear()
+{
+  _meshs.clear();
+  _textures.clear();
+}
+
+} }
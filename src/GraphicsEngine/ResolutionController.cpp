@@ -0,0 +1,41 @@
+#include "ResolutionController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tk { namespace graphics_engine {
+
+void ResolutionController::update(float gpu_ms)
+{
+  // exponential moving average to filter spikes
+  _smoothed_ms = _smoothed_ms == 0.f ? gpu_ms : _smoothed_ms + (gpu_ms - _smoothed_ms) * Smooth_Factor;
+
+  if (gpu_ms > _budget * Decrease_Threshold)
+  {
+    _under_frames = 0;
+    if (++_over_frames < Frames_To_Decrease)
+      return;
+    _over_frames = 0;
+
+    // GPU time is nearly proportional to pixel count, so scale each axis by sqrt of ratio
+    auto ratio   = std::sqrt(_budget * Decrease_Threshold / std::max(gpu_ms, _smoothed_ms));
+    _scale       = std::max(_min_scale, _scale * std::clamp(ratio, .75f, .98f));
+    _smoothed_ms = 0.f;
+  }
+  else if (_smoothed_ms < _budget * Increase_Threshold)
+  {
+    _over_frames = 0;
+    if (++_under_frames < Frames_To_Increase)
+      return;
+    _under_frames = 0;
+
+    _scale = std::min(1.f, _scale + Increase_Step);
+  }
+  else
+  {
+    _over_frames  = 0;
+    _under_frames = 0;
+  }
+}
+
+} }
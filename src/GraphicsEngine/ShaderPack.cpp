@@ -0,0 +1,141 @@
+#include "ShaderPack.hpp"
+#include "ErrorHandling.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+namespace tk { namespace graphics_engine {
+
+// bump when layout of file changed
+static constexpr uint32_t Shader_Pack_Version  = 1;
+static constexpr char     Shader_Pack_Magic[4] = { 'T', 'K', 'S', 'P' };
+static constexpr uint64_t Shader_Pack_Align    = 16;
+
+struct ShaderPackHeader
+{
+  char     magic[4];
+  uint32_t version;
+  uint32_t shader_count;
+  uint32_t reserved;
+};
+
+struct ShaderPackEntry
+{
+  char     name[48];
+  uint64_t offset;
+  uint64_t size;
+};
+
+ShaderPack::ShaderPack(std::filesystem::path const& path)
+  : _file(path)
+{
+  auto bytes   = _file.data();
+  auto in_file = [&](uint64_t offset, uint64_t size)
+  {
+    return offset <= bytes.size() && size <= bytes.size() - offset;
+  };
+
+  ShaderPackHeader header;
+  throw_if(!in_file(0, sizeof(header)), "{} is not a shader pack", path.string());
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  throw_if(std::memcmp(header.magic, Shader_Pack_Magic, sizeof(header.magic)) != 0 ||
+           header.version != Shader_Pack_Version                                    ||
+           !in_file(sizeof(header), (uint64_t)header.shader_count * sizeof(ShaderPackEntry)),
+           "{} is not a shader pack of version {}", path.string(), Shader_Pack_Version);
+
+  for (uint32_t i = 0; i < header.shader_count; ++i)
+  {
+    ShaderPackEntry entry;
+    std::memcpy(&entry, bytes.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+    throw_if(!in_file(entry.offset, entry.size)             ||
+             entry.offset % Shader_Pack_Align != 0          ||
+             entry.size   % sizeof(uint32_t)  != 0          ||
+             entry.name[sizeof(entry.name) - 1] != '\0',
+             "shader {} of {} is broken", i, path.string());
+  }
+  _shader_count = header.shader_count;
+}
+
+auto ShaderPack::get(std::string_view name) const -> std::span<uint32_t const>
+{
+  auto bytes = _file.data();
+  for (uint32_t i = 0; i < _shader_count; ++i)
+  {
+    ShaderPackEntry entry;
+    std::memcpy(&entry, bytes.data() + sizeof(ShaderPackHeader) + i * sizeof(entry), sizeof(entry));
+    if (name != entry.name)
+      continue;
+    // no copy, mapping is page aligned so offsets keep alignment
+    return { reinterpret_cast<uint32_t const*>(bytes.data() + entry.offset), entry.size / sizeof(uint32_t) };
+  }
+  throw_if(true, "shader {} is not in shader pack", name);
+  return {};
+}
+
+void write_shader_pack(std::filesystem::path const& path, std::span<std::filesystem::path const> spv_files)
+{
+  //
+  // read modules and compute offsets
+  //
+  std::vector<std::vector<char>> modules;
+  std::vector<ShaderPackEntry>   entries(spv_files.size());
+  uint64_t offset = sizeof(ShaderPackHeader) + spv_files.size() * sizeof(ShaderPackEntry);
+  for (uint32_t i = 0; i < spv_files.size(); ++i)
+  {
+    auto name = spv_files[i].stem().string();
+    throw_if(name.size() >= sizeof(entries[i].name), "shader name {} is too long", name);
+
+    std::ifstream file(spv_files[i], std::ios::ate | std::ios::binary);
+    throw_if(!file.is_open(), "failed to open {}", spv_files[i].string());
+    auto& data = modules.emplace_back((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    // A SPIR-V module is defined a stream of 32bit words
+    throw_if(!file.good() || data.size() % sizeof(uint32_t) != 0, "failed to read {}", spv_files[i].string());
+
+    std::memcpy(entries[i].name, name.data(), name.size());
+    entries[i].offset = offset = (offset + Shader_Pack_Align - 1) & ~(Shader_Pack_Align - 1);
+    entries[i].size   = data.size();
+    offset += data.size();
+  }
+
+  //
+  // write to temporary file
+  //
+  auto tmp_path = std::filesystem::path(path).concat(".tmp");
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    throw_if(!file.is_open(), "failed to create {}", tmp_path.string());
+
+    ShaderPackHeader header
+    {
+      .version      = Shader_Pack_Version,
+      .shader_count = (uint32_t)entries.size(),
+    };
+    std::memcpy(header.magic, Shader_Pack_Magic, sizeof(header.magic));
+
+    auto write = [&](void const* data, uint64_t size)
+    {
+      file.write(reinterpret_cast<char const*>(data), size);
+    };
+    auto pad = [&](uint64_t offset)
+    {
+      static constexpr char Zeros[Shader_Pack_Align] = {};
+      write(Zeros, offset - file.tellp());
+    };
+
+    write(&header, sizeof(header));
+    write(entries.data(), entries.size() * sizeof(ShaderPackEntry));
+    for (uint32_t i = 0; i < modules.size(); ++i)
+    {
+      pad(entries[i].offset);
+      write(modules[i].data(), modules[i].size());
+    }
+    throw_if(!file.good(), "failed to write {}", tmp_path.string());
+  }
+
+  std::filesystem::rename(tmp_path, path);
+}
+
+} }
@@ -14,11 +14,90 @@ namespace tk { namespace graphics_engine {
     glm::vec4 data2;
   };
 
-  struct UniformBufferObject
+  // flags of present pass, same as shader/present_common.glsl
+  enum PresentFlags : uint32_t
   {
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
-    alignas(16) glm::mat4 proj;
+    Present_Tonemap = 1 << 0,
+    Present_Gamma   = 1 << 1,
+    Present_Dither  = 1 << 2,
+  };
+
+  struct PresentPushConstant
+  {
+    glm::ivec2 input_size;
+    glm::ivec2 output_size;
+    float      sharpness;
+    uint32_t   flags;
+    uint32_t   frame;
+  };
+
+  // max mip levels of hierarchical depth buffer, same as shader/hzb.comp
+  inline constexpr uint32_t Max_Hzb_Mip_Count = 16;
+
+  struct HzbPushConstant
+  {
+    glm::ivec2 src_size;
+    glm::ivec2 dst_size;
+    uint32_t   level;
+  };
+
+  // flags of cull pass, same as shader/cull.comp
+  enum CullFlags : uint32_t
+  {
+    Cull_Frustum   = 1 << 0,
+    Cull_Cone      = 1 << 1,
+    Cull_Occlusion = 1 << 2,
+  };
+
+  // per frame data of cull pass, all in mesh space, std430 layout
+  struct CullData
+  {
+    glm::vec4  frustum_planes[6];
+    glm::vec4  camera_position;
+    // mesh to clip space of the frame which hzb is built from
+    glm::mat4  hzb_matrix;
+    glm::ivec2 hzb_size;
+    uint32_t   hzb_level_count;
+    uint32_t   flags;
+  };
+
+  // indirect command of each surface, padded for alignment of buffer reference
+  struct CullDrawCommand
+  {
+    VkDrawIndexedIndirectCommand command;
+    uint32_t                     padding[3];
+  };
+
+  struct CullPushConstant
+  {
+    VkDeviceAddress meshlets;
+    VkDeviceAddress indices;
+    VkDeviceAddress out_indices;
+    VkDeviceAddress draw_command;
+    VkDeviceAddress cull_data;
+    uint32_t        meshlet_offset;
+    uint32_t        meshlet_count;
+  };
+
+  struct MipgenPushConstant
+  {
+    glm::ivec2 src_size;
+    glm::ivec2 dst_size;
+  };
+
+  // camera of draws in frame data buffer, std430 layout, same as shader/triangle_mesh.vert
+  struct CameraData
+  {
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 view_proj;
+    glm::vec4 position;
+  };
+
+  // transform of an object or instance in frame data buffer
+  struct ObjectData
+  {
+    glm::mat4 world_matrix;
   };
   
   // struct Vertex
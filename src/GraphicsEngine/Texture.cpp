@@ -0,0 +1,113 @@
+#include "Texture.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "ErrorHandling.hpp"
+
+#include <SDL3/SDL_iostream.h>
+#include <SDL3/SDL_surface.h>
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace tk { namespace graphics_engine {
+
+static auto srgb_to_linear(float c)
+{
+  return c <= .04045f ? c / 12.92f : std::pow((c + .055f) / 1.055f, 2.4f);
+}
+
+static auto linear_to_srgb(float c)
+{
+  return c <= .0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - .055f;
+}
+
+//
+// box filter full resolution to tail mip in linear space,
+// blocks of last row and column also cover remainder of non power of two size
+//
+static void make_preview(ImageData& image)
+{
+  while (std::max(image.width >> image.tail_mip, image.height >> image.tail_mip) > Texture_Preview_Size)
+    ++image.tail_mip;
+  if (image.tail_mip == 0)
+    return;
+
+  static auto const lut = []
+  {
+    std::array<float, 256> table;
+    for (uint32_t i = 0; i < table.size(); ++i)
+      table[i] = srgb_to_linear(i / 255.f);
+    return table;
+  }();
+
+  auto width  = std::max(1u, image.width  >> image.tail_mip);
+  auto height = std::max(1u, image.height >> image.tail_mip);
+  auto block  = 1u << image.tail_mip;
+  image.preview.resize(width * height * 4);
+
+  for (uint32_t y = 0; y < height; ++y)
+  for (uint32_t x = 0; x < width; ++x)
+  {
+    auto y_end = y + 1 == height ? image.height : std::min(image.height, (y + 1) * block);
+    auto x_end = x + 1 == width  ? image.width  : std::min(image.width,  (x + 1) * block);
+
+    std::array<float, 4> sum   = {};
+    uint32_t             count = 0;
+    for (auto sy = y * block; sy < y_end; ++sy)
+    for (auto sx = x * block; sx < x_end; ++sx)
+    {
+      auto texel = image.texels.data() + (sy * image.width + sx) * 4;
+      for (uint32_t c = 0; c < 3; ++c)
+        sum[c] += lut[(uint8_t)texel[c]];
+      sum[3] += (uint8_t)texel[3] / 255.f;
+      ++count;
+    }
+
+    auto dst = image.preview.data() + (y * width + x) * 4;
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+      auto v = sum[c] / count;
+      if (c < 3)
+        v = linear_to_srgb(v);
+      dst[c] = (std::byte)std::lround(std::clamp(v, 0.f, 1.f) * 255.f);
+    }
+  }
+}
+
+auto decode_image(std::span<std::byte const> bytes) -> ImageData
+{
+  auto io = SDL_IOFromConstMem(bytes.data(), bytes.size());
+  throw_if(io == nullptr, "failed to open image memory: {}", SDL_GetError());
+  auto surface = SDL_LoadPNG_IO(io, true);
+  throw_if(surface == nullptr, "failed to decode image: {}", SDL_GetError());
+  auto rgba = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+  SDL_DestroySurface(surface);
+  throw_if(rgba == nullptr, "failed to convert image: {}", SDL_GetError());
+
+  ImageData image
+  {
+    .width  = (uint32_t)rgba->w,
+    .height = (uint32_t)rgba->h,
+  };
+  auto row_size = image.width * 4;
+  image.texels.resize(row_size * image.height);
+  for (uint32_t y = 0; y < image.height; ++y)
+    std::memcpy(image.texels.data() + y * row_size, (std::byte const*)rgba->pixels + y * rgba->pitch, row_size);
+  SDL_DestroySurface(rgba);
+
+  image.hash = hash_bytes(bytes);
+  make_preview(image);
+  return image;
+}
+
+auto load_image(std::filesystem::path const& path) -> ImageData
+{
+  auto file    = MappedFile(path);
+  auto image   = decode_image(file.data());
+  image.source = { path };
+  return image;
+}
+
+} }
@@ -17,6 +17,24 @@ inline const std::vector<const char*> Device_Extensions =
 
 inline constexpr uint32_t Max_Frame_Number = 2;
 
+// bytes of each frame's persistently mapped data buffer, e.g. camera, transforms and cull data
+inline constexpr uint32_t Frame_Data_Size = 1024 * 1024;
+
+// max error of mesh lod projected to screen in pixels
+inline constexpr float Lod_Error_Pixels = 1.f;
+
+// vertices, indices and meshlets share one usage, so defragmentation can recreate them alike
+inline constexpr VkBufferUsageFlags Geometry_Buffer_Usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT          |
+                                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT        |
+                                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT          |
+                                                            VK_BUFFER_USAGE_TRANSFER_DST_BIT          |
+                                                            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+// geometry defragmentation starts when free bytes of pool's blocks over this fraction,
+// and moves at most these per frame
+inline constexpr float    Defrag_Free_Ratio      = .25f;
+inline constexpr uint32_t Defrag_Bytes_Per_Frame = 8 * 1024 * 1024;
+inline constexpr uint32_t Defrag_Moves_Per_Frame = 64;
+
 inline std::vector<Vertex> Vertices
 {
   { {  .5f, -.5f,  0.f }, {}, {}, {}, { 0.f, 0.f, 0.f, 1.f } },
@@ -0,0 +1,141 @@
+#include "GraphicsEngine.hpp"
+#include "ErrorHandling.hpp"
+#include "Log.hpp"
+#include "HeapGuard.hpp"
+#include "constant.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace tk { namespace graphics_engine {
+
+//
+// VMA reserves new places of a pass, moved buffers are recreated there and copied by this frame.
+// handles and addresses are patched at once, so later commands of this frame use new buffers.
+// old places are freed when pass ended, after this frame finished and old buffers destroyed.
+//
+void GraphicsEngine::defragment_geometry(FrameResource& frame)
+{
+  if (_defrag_serial != 0)
+    return;
+
+  if (_defrag_context == VK_NULL_HANDLE)
+  {
+    // only worth when a block may be freed,
+    // and pool changed since last run, otherwise nothing more can be moved
+    VmaStatistics stats;
+    vmaGetPoolStatistics(_vma_allocator, _geometry_pool, &stats);
+    auto free_bytes = stats.blockBytes - stats.allocationBytes;
+    if (stats.blockCount < 2 || free_bytes < stats.blockBytes * Defrag_Free_Ratio)
+      return;
+    if (stats.allocationCount == _defrag_last_stats.allocationCount &&
+        stats.allocationBytes == _defrag_last_stats.allocationBytes &&
+        stats.blockBytes      == _defrag_last_stats.blockBytes)
+      return;
+
+    VmaDefragmentationInfo info
+    {
+      .flags                 = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+      .pool                  = _geometry_pool,
+      .maxBytesPerPass       = Defrag_Bytes_Per_Frame,
+      .maxAllocationsPerPass = Defrag_Moves_Per_Frame,
+    };
+    throw_if(vmaBeginDefragmentation(_vma_allocator, &info, &_defrag_context) != VK_SUCCESS,
+             "failed to begin defragmentation");
+  }
+
+  // passes are occasional, patching meshs and logging may allocate
+  auto allow_heap = AllowHeapScope();
+  auto res = vmaBeginDefragmentationPass(_vma_allocator, _defrag_context, &_defrag_pass);
+  if (res == VK_SUCCESS)
+  {
+    // nothing left to move
+    end_defragmentation();
+    return;
+  }
+  throw_if(res != VK_INCOMPLETE, "failed to begin defragmentation pass");
+
+  auto cmd = frame.command_buffer;
+  for (uint32_t i = 0; i < _defrag_pass.moveCount; ++i)
+  {
+    auto& move = _defrag_pass.pMoves[i];
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(_vma_allocator, move.srcAllocation, &info);
+    auto mesh_buffer = static_cast<MeshBuffer*>(info.pUserData);
+    if (mesh_buffer == nullptr)
+    {
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+
+    std::array<std::pair<Buffer*, VkDeviceAddress*>, 3> buffers
+    {{
+      { &mesh_buffer->vertices, &mesh_buffer->address         },
+      { &mesh_buffer->indices,  &mesh_buffer->index_address   },
+      { &mesh_buffer->meshlets, &mesh_buffer->meshlet_address },
+    }};
+    auto it = std::ranges::find(buffers, move.srcAllocation, [](auto const& entry) { return entry.first->allocation; });
+    if (it == buffers.end())
+    {
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+    auto [buffer, address] = *it;
+
+    VkBufferCreateInfo buffer_info
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size  = buffer->size,
+      .usage = Geometry_Buffer_Usage,
+    };
+    VkBuffer new_buffer;
+    throw_if(vkCreateBuffer(_device, &buffer_info, nullptr, &new_buffer) != VK_SUCCESS,
+             "failed to create buffer");
+    throw_if(vmaBindBufferMemory(_vma_allocator, move.dstTmpAllocation, new_buffer) != VK_SUCCESS,
+             "failed to bind buffer memory");
+
+    VkBufferCopy region
+    {
+      .size = buffer->size,
+    };
+    vkCmdCopyBuffer(cmd, buffer->buffer, new_buffer, 1, &region);
+
+    // allocation is kept, it points to new place after pass ended
+    defer_destroy(Buffer{ .buffer = buffer->buffer });
+    buffer->buffer = new_buffer;
+    *address       = get_buffer_address(new_buffer);
+  }
+
+  memory_barrier(cmd, VK_PIPELINE_STAGE_2_COPY_BIT,         VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT);
+  _defrag_serial = _submitted_serial + 1;
+}
+
+void GraphicsEngine::end_defragmentation()
+{
+  VmaDefragmentationStats stats;
+  vmaEndDefragmentation(_vma_allocator, _defrag_context, &stats);
+  _defrag_context = VK_NULL_HANDLE;
+  vmaGetPoolStatistics(_vma_allocator, _geometry_pool, &_defrag_last_stats);
+  if (stats.bytesMoved > 0)
+    log::info("geometry defragmented: {} bytes moved, {} bytes freed, {} blocks freed",
+              stats.bytesMoved, stats.bytesFreed, stats.deviceMemoryBlocksFreed);
+}
+
+void GraphicsEngine::end_defragment_pass()
+{
+  if (_defrag_serial == 0)
+    return;
+  _defrag_serial = 0;
+
+  auto allow_heap = AllowHeapScope();
+  if (vmaEndDefragmentationPass(_vma_allocator, _defrag_context, &_defrag_pass) == VK_SUCCESS)
+    end_defragmentation();
+
+  for (auto const& mesh_buffer : _defrag_released)
+    destroy_mesh_buffer(mesh_buffer);
+  _defrag_released.clear();
+}
+
+} }
@@ -1,14 +1,283 @@
 #include "gltf.hpp"
 #include "ErrorHandling.hpp"
-#include "GraphicsEngine.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshletBuilder.hpp"
+#include "Log.hpp"
 
 #include <fastgltf/core.hpp>
 #include <fastgltf/tools.hpp>
 #include <fastgltf/glm_element_traits.hpp>
 
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <variant>
+
 namespace tk { namespace graphics_engine {
 
-auto load_gltf(class GraphicsEngine* engine, std::filesystem::path file_path) -> std::vector<std::shared_ptr<MeshAsset>>
+//
+// float vertex attribute source, elements are read with byte stride.
+// missing attribute has stride 0, so its default value is read for every vertex.
+//
+struct AttributeStream
+{
+  std::byte const* data   = nullptr;
+  size_t           stride = 0;
+
+  template <typename T>
+  auto get(size_t idx) const
+  {
+    T v;
+    std::memcpy(&v, data + idx * stride, sizeof(T));
+    return v;
+  }
+};
+
+//
+// float accessors which are not normalized and not sparse are read from buffer directly,
+// others (normalized integers, sparse) are decoded to scratch in one bulk call,
+// so interleave pass only needs to handle strided floats.
+//
+template <typename T>
+static auto get_attribute_stream(fastgltf::Asset const& asset, fastgltf::Accessor const& accessor, std::vector<T>& scratch) -> AttributeStream
+{
+  constexpr auto Components = sizeof(T) / sizeof(float);
+  if (accessor.componentType == fastgltf::ComponentType::Float  &&
+      fastgltf::getNumComponents(accessor.type) == Components   &&
+      !accessor.normalized                                      &&
+      !accessor.sparse.has_value()                              &&
+      accessor.bufferViewIndex.has_value())
+  {
+    auto& view  = asset.bufferViews[accessor.bufferViewIndex.value()];
+    auto  bytes = fastgltf::DefaultBufferDataAdapter()(asset, accessor.bufferViewIndex.value());
+    return { bytes.data() + accessor.byteOffset, view.byteStride.has_value() ? view.byteStride.value() : sizeof(T) };
+  }
+
+  scratch.resize(accessor.count);
+  fastgltf::copyFromAccessor<T>(asset, accessor, scratch.data());
+  return { reinterpret_cast<std::byte const*>(scratch.data()), sizeof(T) };
+}
+
+template <typename T>
+static auto get_default_stream(T const& value) -> AttributeStream
+{
+  return { reinterpret_cast<std::byte const*>(&value), 0 };
+}
+
+static glm::vec3 const Default_Normal = { 1.f, 0.f, 0.f };
+static glm::vec2 const Default_UV     = { 0.f, 0.f };
+static glm::vec4 const Default_Color  = { 1.f, 1.f, 1.f, 1.f };
+
+//
+// scratch of decoded accessors, one per worker thread
+//
+struct AttributeScratch
+{
+  std::vector<glm::vec3> pos;
+  std::vector<glm::vec3> normal;
+  std::vector<glm::vec2> uv;
+  std::vector<glm::vec3> color3;
+  std::vector<glm::vec4> color;
+};
+
+//
+// decode a primitive into its pre-sized output range,
+// indices are offset by base_vertex which is primitive's first vertex in mesh.
+//
+static void load_primitive(fastgltf::Asset const& asset, fastgltf::Primitive const& p,
+                           Vertex* vertices, uint32_t* indices, uint32_t base_vertex,
+                           AttributeScratch& scratch)
+{
+  // load indices, decode whole accessor then offset them in one pass
+  auto& index_accessor = asset.accessors[p.indicesAccessor.value()];
+  fastgltf::copyFromAccessor<std::uint32_t>(asset, index_accessor, indices);
+  for (size_t i = 0; i < index_accessor.count; ++i)
+    indices[i] += base_vertex;
+
+  // get attribute streams
+  auto& pos_accessor = asset.accessors[p.findAttribute("POSITION")->accessorIndex];
+  auto  count        = pos_accessor.count;
+  auto  pos          = get_attribute_stream(asset, pos_accessor, scratch.pos);
+
+  auto normal = get_default_stream(Default_Normal);
+  auto uv     = get_default_stream(Default_UV);
+  auto color  = get_default_stream(Default_Color);
+  if (auto it = p.findAttribute("NORMAL"); it != p.attributes.end())
+    normal = get_attribute_stream(asset, asset.accessors[it->accessorIndex], scratch.normal);
+  if (auto it = p.findAttribute("TEXCOORD_0"); it != p.attributes.end())
+    uv = get_attribute_stream(asset, asset.accessors[it->accessorIndex], scratch.uv);
+
+  // rgb color is expanded to rgba with opaque alpha
+  if (auto it = p.findAttribute("COLOR_0"); it != p.attributes.end())
+  {
+    auto& accessor = asset.accessors[it->accessorIndex];
+    if (accessor.type == fastgltf::AccessorType::Vec4)
+      color = get_attribute_stream(asset, accessor, scratch.color);
+    else if (accessor.type == fastgltf::AccessorType::Vec3)
+    {
+      auto rgb = get_attribute_stream(asset, accessor, scratch.color3);
+      scratch.color.resize(accessor.count);
+      for (size_t i = 0; i < accessor.count; ++i)
+        scratch.color[i] = glm::vec4(rgb.get<glm::vec3>(i), 1.f);
+      color = { reinterpret_cast<std::byte const*>(scratch.color.data()), sizeof(glm::vec4) };
+    }
+  }
+
+  //
+  // interleave all attributes in single pass, without branch per vertex
+  //
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto& vtx  = vertices[i];
+    auto  v    = uv.get<glm::vec2>(i);
+    vtx.pos    = pos.get<glm::vec3>(i);
+    vtx.uv_x   = v.x;
+    vtx.normal = normal.get<glm::vec3>(i);
+    vtx.uv_y   = v.y;
+    vtx.color  = color.get<glm::vec4>(i);
+  }
+}
+
+//
+// workers shared by all phases of all loads, created at first use and joined at exit.
+// caller of run() also takes jobs of its batch, so concurrent loads always progress.
+//
+class WorkerPool
+{
+public:
+  static auto get() -> WorkerPool&
+  {
+    static auto pool = WorkerPool();
+    return pool;
+  }
+
+  ~WorkerPool()
+  {
+    {
+      auto lock = std::lock_guard(_mutex);
+      _stop     = true;
+    }
+    _work_cv.notify_all();
+    for (auto& thread : _threads)
+      thread.join();
+  }
+
+  // rethrow first exception after all jobs finished
+  template <typename Func>
+  void run(uint32_t count, Func& func)
+  {
+    auto batch = Batch
+    {
+      .invoke = [](void* func, uint32_t i) { (*static_cast<Func*>(func))(i); },
+      .func   = &func,
+      .count  = count,
+    };
+    {
+      auto lock = std::lock_guard(_mutex);
+      _batches.push_back(&batch);
+    }
+    _work_cv.notify_all();
+
+    work(batch);
+
+    // workers still running jobs of batch are waited, others never see it again
+    {
+      auto lock = std::unique_lock(_mutex);
+      std::erase(_batches, &batch);
+      _done_cv.wait(lock, [&] { return batch.workers == 0; });
+    }
+    if (batch.exception)
+      std::rethrow_exception(batch.exception);
+  }
+
+private:
+  struct Batch
+  {
+    void                  (*invoke)(void* func, uint32_t i);
+    void*                 func;
+    uint32_t              count;
+    std::atomic<uint32_t> next    = 0;
+    // workers running jobs of batch, guarded by mutex of pool
+    uint32_t              workers = 0;
+    std::exception_ptr    exception;
+    std::mutex            exception_mutex;
+  };
+
+  WorkerPool()
+  {
+    auto thread_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    for (uint32_t i = 0; i < thread_count; ++i)
+      _threads.emplace_back([this] { worker_loop(); });
+  }
+
+  static void work(Batch& batch)
+  {
+    for (auto i = batch.next++; i < batch.count; i = batch.next++)
+    {
+      try
+      {
+        batch.invoke(batch.func, i);
+      }
+      catch (...)
+      {
+        auto lock = std::lock_guard(batch.exception_mutex);
+        if (!batch.exception)
+          batch.exception = std::current_exception();
+      }
+    }
+  }
+
+  void worker_loop()
+  {
+    auto lock = std::unique_lock(_mutex);
+    while (true)
+    {
+      _work_cv.wait(lock, [this] { return _stop || !_batches.empty(); });
+      if (_stop)
+        return;
+
+      auto batch = _batches.front();
+      ++batch->workers;
+      lock.unlock();
+      work(*batch);
+      lock.lock();
+
+      // all jobs are taken, so batch is not offered to other workers
+      std::erase(_batches, batch);
+      if (--batch->workers == 0)
+        _done_cv.notify_all();
+    }
+  }
+
+  std::mutex               _mutex;
+  std::condition_variable  _work_cv;
+  std::condition_variable  _done_cv;
+  std::vector<Batch*>      _batches;
+  std::vector<std::thread> _threads;
+  bool                     _stop = false;
+};
+
+//
+// run jobs on persistent workers and current thread, rethrow first exception after all finished
+//
+template <typename Func>
+static void parallel_for(uint32_t count, Func&& func)
+{
+  WorkerPool::get().run(count, func);
+}
+
+//
+// parse gltf, vertices, indices and meshlets are stored in outputs which cooked meshs point to
+//
+static auto parse_gltf(std::filesystem::path const& file_path, bool build_meshlets,
+                       std::vector<std::vector<Vertex>>& vertices,
+                       std::vector<std::vector<uint32_t>>& indices,
+                       std::vector<std::vector<Meshlet>>& meshlets) -> std::vector<CookedMesh>
 {
   // read data from glft
   auto data = fastgltf::GltfDataBuffer().FromPath(file_path);
@@ -16,104 +285,280 @@ auto load_gltf(class GraphicsEngine* engine, std::filesystem::path file_path) ->
   throw_if(load.error() != fastgltf::Error::None, "failed to load gltf");
   auto asset = std::move(load.get());
 
-  // transform data to vector<MeshAsset>
-  auto meshs    = std::vector<std::shared_ptr<MeshAsset>>();
-  auto vertices = std::vector<Vertex>();
-  auto indices  = std::vector<uint32_t>();
-  for (auto& mesh : asset.meshes)
+  //
+  // size all outputs from accessor counts, so primitives can be decoded concurrently
+  //
+  struct PrimitiveJob
   {
-    MeshAsset mesh_asset;
-    mesh_asset.name = mesh.name;
-
-    vertices.clear();
-    indices.clear();
+    uint32_t mesh;
+    uint32_t primitive;
+    uint32_t vertex_offset;
+    uint32_t index_offset;
+  };
+  auto jobs  = std::vector<PrimitiveJob>();
+  auto meshs = std::vector<CookedMesh>(asset.meshes.size());
+  vertices.resize(asset.meshes.size());
+  indices.resize(asset.meshes.size());
+  meshlets.resize(asset.meshes.size());
+  for (uint32_t m = 0; m < asset.meshes.size(); ++m)
+  {
+    auto& mesh    = asset.meshes[m];
+    meshs[m].name = mesh.name;
 
-    for (auto&& p : mesh.primitives)
+    uint32_t vertex_count = 0;
+    uint32_t index_count  = 0;
+    for (uint32_t i = 0; i < mesh.primitives.size(); ++i)
     {
+      auto& p = mesh.primitives[i];
+      jobs.emplace_back(m, i, vertex_count, index_count);
+
       GeometrySurface surface;
-      surface.start_index = indices.size();
+      surface.start_index = index_count;
       surface.count       = asset.accessors[p.indicesAccessor.value()].count;
+      surface.lods[0]     = { surface.start_index, surface.count, 0.f };
 
-      auto init_vertex = vertices.size();
-      // load indices
-      {
-        auto& index_accessor = asset.accessors[p.indicesAccessor.value()];
-        indices.reserve(indices.size() + index_accessor.count);
-        fastgltf::iterateAccessor<std::uint32_t>(asset, index_accessor,
-        [&](std::uint32_t idx)
-        {
-          indices.push_back(idx + init_vertex);
-        });
-      }
+      // texture and sampler are resolved to image, sampler is shared by all textures
+      if (p.materialIndex)
+        if (auto& info = asset.materials[p.materialIndex.value()].pbrData.baseColorTexture)
+          if (auto image = asset.textures[info->textureIndex].imageIndex)
+            surface.image = image.value();
+      meshs[m].surfaces.push_back(surface);
 
-      // load vertices
-      {
-        auto& pos_accessor = asset.accessors[p.findAttribute("POSITION")->accessorIndex];
-        vertices.resize(vertices.size() + pos_accessor.count);
-        fastgltf::iterateAccessorWithIndex<glm::vec3>(asset, pos_accessor,
-        [&](glm::vec3 v, size_t idx)
-        {
-          Vertex vtx = {};
-          vtx.pos    = v;
-          vtx.color  = glm::vec4(1.f);
-          vtx.normal = { 1, 0, 0 };
-          vertices[init_vertex + idx] = vtx;
-        });
-      }
+      vertex_count += asset.accessors[p.findAttribute("POSITION")->accessorIndex].count;
+      index_count  += surface.count;
+    }
+    vertices[m].resize(vertex_count);
+    indices[m].resize(index_count);
+  }
 
-      // load normal
-      {
-        auto normals = p.findAttribute("NORMAL");
-        if (normals != p.attributes.end())
-        {
-          fastgltf::iterateAccessorWithIndex<glm::vec3>(asset, asset.accessors[normals->accessorIndex],
-          [&](glm::vec3 v, size_t idx)
-          {
-            vertices[init_vertex + idx].normal = v;
-          });
-        }
-      }
+  //
+  // decode primitives concurrently
+  //
+  parallel_for(jobs.size(), [&](uint32_t i)
+  {
+    thread_local AttributeScratch scratch;
+    auto& job = jobs[i];
+    load_primitive(asset, asset.meshes[job.mesh].primitives[job.primitive],
+                   vertices[job.mesh].data() + job.vertex_offset,
+                   indices[job.mesh].data() + job.index_offset,
+                   job.vertex_offset, scratch);
+  });
 
-      // load uv
-      {
-        auto uvs = p.findAttribute("TEXCOORD_0");
-        if (uvs != p.attributes.end())
-        {
-          fastgltf::iterateAccessorWithIndex<glm::vec2>(asset, asset.accessors[uvs->accessorIndex],
-          [&](glm::vec2 v, size_t idx)
-          {
-            vertices[init_vertex + idx].uv_x = v.x;
-            vertices[init_vertex + idx].uv_y = v.y;
-          });
-        }
-      }
+  //
+  // optimize each mesh for vertex cache, overdraw and vertex fetch,
+  // then append lod indices after full detail indices, and split all lods to meshlets
+  //
+  struct OptimizeStats
+  {
+    size_t vertices_before   = 0;
+    size_t vertices_after    = 0;
+    // ACMR weighted by triangles
+    float  transforms_before = 0.f;
+    float  transforms_after  = 0.f;
+    size_t triangles         = 0;
+    size_t lod_triangles     = 0;
+  };
+  auto stats = std::vector<OptimizeStats>(meshs.size());
+  parallel_for(meshs.size(), [&](uint32_t m)
+  {
+    auto& stat             = stats[m];
+    stat.triangles         = indices[m].size() / 3;
+    stat.vertices_before   = vertices[m].size();
+    stat.transforms_before = analyze_vertex_cache(indices[m], vertices[m].size()) * stat.triangles;
+    optimize_mesh(vertices[m], indices[m], meshs[m].surfaces);
+    stat.vertices_after    = vertices[m].size();
+    stat.transforms_after  = analyze_vertex_cache(indices[m], vertices[m].size()) * stat.triangles;
 
-      // load color
-      {
-        auto colors = p.findAttribute("COLOR_0");
-        if (colors != p.attributes.end())
-        {
-          fastgltf::iterateAccessorWithIndex<glm::vec4>(asset, asset.accessors[colors->accessorIndex],
-          [&](glm::vec4 v, size_t idx)
-          {
-            vertices[init_vertex + idx].color = v;
-          });
-        }
-      }
+    generate_lods(vertices[m], indices[m], meshs[m].surfaces);
+    for (auto const& surface : meshs[m].surfaces)
+      for (uint32_t i = 1; i < surface.lod_count; ++i)
+        stat.lod_triangles += surface.lods[i].count / 3;
 
-      mesh_asset.surfaces.push_back(surface);
+    if (build_meshlets)
+      graphics_engine::build_meshlets(vertices[m], indices[m], meshs[m].surfaces, meshlets[m]);
+  });
+
+  // one line per file, large levels have too many meshs to log each
+  auto total = OptimizeStats();
+  for (auto const& stat : stats)
+  {
+    total.vertices_before   += stat.vertices_before;
+    total.vertices_after    += stat.vertices_after;
+    total.transforms_before += stat.transforms_before;
+    total.transforms_after  += stat.transforms_after;
+    total.triangles         += stat.triangles;
+    total.lod_triangles     += stat.lod_triangles;
+  }
+  auto triangles = std::max<size_t>(1, total.triangles);
+  log::info("import {}: {} meshs, vertices {} -> {}, ACMR {:.3f} -> {:.3f}, triangles {} + {} in lods",
+            file_path.filename().string(), meshs.size(), total.vertices_before, total.vertices_after,
+            total.transforms_before / triangles, total.transforms_after / triangles, total.triangles, total.lod_triangles);
+
+  for (uint32_t m = 0; m < meshs.size(); ++m)
+  {
+    meshs[m].data = { vertices[m], indices[m], meshlets[m] };
+    if (vertices[m].empty())
+      continue;
+    auto& bounds = meshs[m].bounds;
+    bounds.min = bounds.max = vertices[m].front().pos;
+    for (auto const& vtx : vertices[m])
+    {
+      bounds.min = glm::min(bounds.min, vtx.pos);
+      bounds.max = glm::max(bounds.max, vtx.pos);
     }
+  }
+
+  return meshs;
+}
 
-    for (auto& vtx : vertices)
+static auto load_gltf_asset(std::filesystem::path const& file_path)
+{
+  auto data = fastgltf::GltfDataBuffer().FromPath(file_path);
+  auto load = fastgltf::Parser().loadGltfBinary(data.get(), file_path.parent_path(), fastgltf::Options::None);
+  throw_if(load.error() != fastgltf::Error::None, "failed to load gltf");
+  return std::move(load.get());
+}
+
+// embedded image remembers gltf and its index, image file remembers its path
+static auto decode_gltf_image(fastgltf::Asset const& asset, std::filesystem::path const& file_path, uint32_t index) -> ImageData
+{
+  auto image = ImageData();
+  std::visit(fastgltf::visitor
+  {
+    [&](fastgltf::sources::BufferView const& view)
+    {
+      auto bytes   = fastgltf::DefaultBufferDataAdapter()(asset, view.bufferViewIndex);
+      image        = decode_image({ bytes.data(), bytes.size() });
+      image.source = { file_path, index };
+    },
+    [&](fastgltf::sources::Array const& array)
     {
-      vtx.color = glm::vec4(vtx.normal, 1.f);
+      image        = decode_image({ array.bytes.data(), array.bytes.size() });
+      image.source = { file_path, index };
+    },
+    [&](fastgltf::sources::URI const& uri)
+    {
+      throw_if(!uri.uri.isLocalPath(), "image is not local file");
+      image = load_image(file_path.parent_path() / uri.uri.fspath());
+    },
+    [](auto const&)
+    {
+      throw_if(true, "unsupported image source");
+    },
+  }, asset.images[index].data);
+  return image;
+}
+
+auto load_gltf_image(std::filesystem::path const& path, uint32_t index) -> ImageData
+{
+  auto asset = load_gltf_asset(path);
+  throw_if(index >= asset.images.size(), "image {} is not in {}", index, path.string());
+  return decode_gltf_image(asset, path, index);
+}
+
+//
+// decode all images of gltf concurrently, image failed to decode is left empty
+//
+static auto decode_gltf_images(std::filesystem::path const& file_path) -> std::vector<ImageData>
+{
+  auto asset  = load_gltf_asset(file_path);
+  auto images = std::vector<ImageData>(asset.images.size());
+  parallel_for(images.size(), [&](uint32_t i)
+  {
+    try
+    {
+      images[i] = decode_gltf_image(asset, file_path, i);
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to decode image {} of {}: {}", i, file_path.string(), e.what());
+    }
+  });
+  return images;
+}
+
+//
+// structs with padding are hashed field by field, padding bytes are not initialized.
+// images are part of content, same geometry with different textures is not shared.
+// hash_bytes is a callable of hash_bytes(bytes, hash = seed).
+//
+template <typename Hash>
+static auto hash_mesh(CookedMesh const& mesh, std::span<ImageData const> images, Hash&& hash_bytes) -> uint64_t
+{
+  // vertex has no padding, see MeshOptimizer
+  auto hash       = hash_bytes(std::as_bytes(mesh.data.vertices));
+  auto hash_value = [&](auto const& value) { hash = hash_bytes(std::as_bytes(std::span(&value, 1)), hash); };
+  hash = hash_bytes(std::as_bytes(mesh.data.indices), hash);
+  for (auto const& meshlet : mesh.data.meshlets)
+  {
+    hash_value(meshlet.sphere);
+    hash_value(meshlet.cone);
+    hash_value(meshlet.start_index);
+    hash_value(meshlet.triangle_count);
+  }
+  for (auto const& surface : mesh.surfaces)
+  {
+    hash_value(surface.start_index);
+    hash_value(surface.count);
+    hash_value(surface.lod_count);
+    for (uint32_t i = 0; i < std::min(surface.lod_count, Max_Lod_Count); ++i)
+    {
+      hash_value(surface.lods[i].start_index);
+      hash_value(surface.lods[i].count);
+      hash_value(surface.lods[i].error);
+      hash_value(surface.lods[i].meshlet_offset);
+      hash_value(surface.lods[i].meshlet_count);
     }
+    hash_value(surface.image);
+    if (surface.image < images.size())
+      hash_value(images[surface.image].hash);
+  }
+  return hash;
+}
+
+auto cook_gltf(std::filesystem::path const& file_path, uint64_t source_hash, bool build_meshlets) -> CookedGltf
+{
+  auto cache_path = std::filesystem::path(file_path).replace_extension(".tkmesh");
+  auto cooked     = CookedGltf();
+
+  // cache written without meshlets is stale when they are needed now
+  auto meshs = read_mesh_cache(cache_path, source_hash, cooked.cache_file);
+  if (meshs && build_meshlets &&
+      std::ranges::any_of(*meshs, [](auto const& mesh) { return !mesh.data.indices.empty() && mesh.data.meshlets.empty(); }))
+    meshs.reset();
+  if (meshs && !build_meshlets)
+    for (auto& mesh : *meshs)
+      mesh.data.meshlets = {};
+
+  if (!meshs)
+  {
+    meshs = parse_gltf(file_path, build_meshlets, cooked.vertices, cooked.indices, cooked.meshlets);
 
-    mesh_asset.mesh_buffer = engine->create_mesh_buffer(vertices, indices);
-    meshs.emplace_back(std::make_shared<MeshAsset>(std::move(mesh_asset)));
+    // failed to write cache is not fatal, just parse again next time
+    try
+    {
+      write_mesh_cache(cache_path, source_hash, *meshs);
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to write mesh cache: {}", e.what());
+    }
   }
 
-  return meshs;
+  // images are not cooked, png is already compressed
+  if (std::ranges::any_of(*meshs, [](auto const& mesh)
+      {
+        return std::ranges::any_of(mesh.surfaces, [](auto const& surface) { return surface.image != No_Image; });
+      }))
+    cooked.images = decode_gltf_images(file_path);
+
+  for (auto& mesh : *meshs)
+  {
+    mesh.content_hash  = hash_mesh(mesh, cooked.images, [](auto... args) { return hash_bytes(args...); });
+    mesh.content_check = hash_mesh(mesh, cooked.images, [](auto... args) { return check_hash_bytes(args...); });
+  }
+  cooked.meshs = std::move(*meshs);
+  return cooked;
 }
 
 } }
@@ -4,7 +4,7 @@
 #include "ErrorHandling.hpp"
 #include "Window.hpp"
 
-#include <fstream>
+#include <algorithm>
 #include <map>
 #include <print>
 
@@ -159,6 +159,19 @@ inline auto check_instance_extensions_support(std::vector<const char*> extension
   }
 }
 
+// for optional instance extensions
+inline auto has_instance_extensions(std::vector<const char*> const& extensions)
+{
+  auto supported_extensions = get_supported_instance_extensions();
+  return std::ranges::all_of(extensions, [&](auto extension)
+  {
+    return std::ranges::any_of(supported_extensions, [extension](auto const& supported_extension)
+    {
+      return strcmp(supported_extension.extensionName, extension) == 0;
+    });
+  });
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //                              Physical Device 
@@ -204,6 +217,38 @@ inline auto get_physical_devices_score(std::vector<VkPhysicalDevice> const& devi
   return devices_score;
 }
 
+// features which engine can't work without
+inline auto check_required_features(VkPhysicalDevice device)
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_4)
+    return false;
+
+  VkPhysicalDeviceVulkan14Features features14{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES };
+  VkPhysicalDeviceVulkan12Features features12
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext = &features14,
+  };
+  VkPhysicalDeviceFeatures2 features2
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &features12,
+  };
+  vkGetPhysicalDeviceFeatures2(device, &features2);
+  // mipgen pushes descriptors, mesh.frag indexes textures and hzb indexes mips by push constant
+  auto indexing = features14.pushDescriptor                                 &&
+                  features2.features.shaderSampledImageArrayDynamicIndexing &&
+                  features2.features.shaderStorageImageArrayDynamicIndexing;
+  // bindless texture slots are written while other slots are used by frames in flight
+  auto bindless = features12.descriptorIndexing                           &&
+                  features12.descriptorBindingSampledImageUpdateAfterBind &&
+                  features12.descriptorBindingUpdateUnusedWhilePending    &&
+                  features12.descriptorBindingPartiallyBound;
+  return indexing && bindless;
+}
+
 inline void print_supported_physical_devices(VkInstance instance)
 {
   auto devices = get_supported_physical_devices(instance);
@@ -425,52 +470,4 @@ inline VkImageView create_image_view(VkDevice device, VkImage image, VkFormat fo
   return view;
 }
 
-
-////////////////////////////////////////////////////////////////////////////////
-//                               Shader 
-////////////////////////////////////////////////////////////////////////////////
-
-inline auto get_file_data(std::string_view filename)
-{
-  std::ifstream file(filename.data(), std::ios::ate | std::ios::binary);
-  throw_if(!file.is_open(), "failed to open {}", filename);
-
-  auto file_size = (size_t)file.tellg();
-  // A SPIR-V module is defined a stream of 32bit words
-  auto buffer    = std::vector<uint32_t>(file_size / sizeof(uint32_t));
-  
-  file.seekg(0);
-  file.read((char*)buffer.data(), file_size);
-
-  file.close();
-  return buffer;
-}
-
-struct Shader
-{
-  VkShaderModule shader;
-
-  Shader(VkDevice device, std::string_view filename)
-    : _device(device)
-  {
-    auto data = get_file_data(filename);
-    VkShaderModuleCreateInfo info
-    {
-      .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .codeSize = data.size() * sizeof(uint32_t),
-      .pCode    = reinterpret_cast<uint32_t*>(data.data()),
-    };
-    throw_if(vkCreateShaderModule(device, &info, nullptr, &shader) != VK_SUCCESS,
-             "failed to create shader from {}", filename);
-  }
-
-  ~Shader()
-  {
-    vkDestroyShaderModule(_device, shader, nullptr);
-  }
-
-private:
-  VkDevice _device;
-};
-
 } }
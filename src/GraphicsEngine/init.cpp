@@ -2,10 +2,18 @@
 #include "init-util.hpp"
 #include "constant.hpp"
 #include "PipelineBuilder.hpp"
+#include "ShaderStructs.hpp"
+#include "HeapGuard.hpp"
+#include "AllocationTracker.hpp"
 
+#include <SDL3/SDL_filesystem.h>
+
+#include <array>
 #include <ranges>
 #include <set>
 #include <print>
+#include <bit>
+#include <algorithm>
 
 namespace tk { namespace graphics_engine { 
 
@@ -25,25 +33,37 @@ GraphicsEngine::GraphicsEngine(Window const& window)
   select_physical_device();
   create_device_and_get_queues();
   create_vma_allocator();
+  create_geometry_pool();
   create_swapchain_and_rendering_image();
   create_descriptor_set_layout();
+  create_pipeline_registry();
+  create_texture_resources();
   create_compute_pipeline();
   create_graphics_pipeline();
+  create_present_pipelines();
+  create_cull_pipelines();
   create_command_pool();
-  create_descriptor_pool();
-  create_descriptor_sets();
   create_frame_resources();
+  create_frame_data_buffers();
+  create_descriptor_allocators();
+  create_descriptor_sets();
+  create_query_pool();
 
   upload_data();
+  create_default_texture();
 
   load_gltf();
+  create_cull_buffers();
 }
 
 GraphicsEngine::~GraphicsEngine()
 {
   vkDeviceWaitIdle(_device);
-  for (auto& frame : _frames)
-    frame.destructors.clear();
+  _deletion_queue.flush(_device, _vma_allocator);
+  // copies of pass are finished after device idle
+  end_defragment_pass();
+  if (_defrag_context != VK_NULL_HANDLE)
+    vmaEndDefragmentation(_vma_allocator, _defrag_context, nullptr);
   _destructors.clear();
 }
 
@@ -68,8 +88,16 @@ void GraphicsEngine::create_instance()
   check_layers_support({ validation_layer });
 #endif
 
-  // extensions
+  // extensions, surface maintenance is needed by optional swapchain maintenance
   auto extensions = get_instance_extensions();
+  auto surface_maintenance_extensions = std::vector<const char*>
+  {
+    VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
+    VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME,
+  };
+  _surface_maintenance_supported = has_instance_extensions(surface_maintenance_extensions);
+  if (_surface_maintenance_supported)
+    extensions.append_range(surface_maintenance_extensions);
 #ifndef NDEBUG
   print_supported_instance_extensions();
 #endif
@@ -125,6 +153,7 @@ void GraphicsEngine::select_physical_device()
     {
       auto queue_family_indices = get_queue_family_indices(device, _surface);
       if (check_device_extensions_support(device, Device_Extensions) &&
+          check_required_features(device)                            &&
           !get_swapchain_details(device, _surface).has_empty())
       {
         _physical_device = device;
@@ -166,26 +195,108 @@ void GraphicsEngine::create_device_and_get_queues()
       .pQueuePriorities = &priority,
     });
 
+  // optional features
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(_physical_device, &supported_features);
+  _storage_write_without_format = supported_features.shaderStorageImageWriteWithoutFormat;
+
   // features
+  VkPhysicalDeviceVulkan14Features features14
+  {
+    .sType               = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES,
+    .pushDescriptor      = true,
+  };
   VkPhysicalDeviceVulkan13Features features13
   { 
     .sType               = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    .pNext               = &features14,
     .synchronization2    = true,
     .dynamicRendering    = true,
   };
   VkPhysicalDeviceVulkan12Features features12
   { 
-    .sType               = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
-    .pNext               = &features13,
-    .descriptorIndexing  = true,
-    .bufferDeviceAddress = true,
+    .sType                                         = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext                                         = &features13,
+    .descriptorIndexing                            = true,
+    .descriptorBindingSampledImageUpdateAfterBind  = true,
+    .descriptorBindingUpdateUnusedWhilePending     = true,
+    .descriptorBindingPartiallyBound               = true,
+    .timelineSemaphore                             = true,
+    .bufferDeviceAddress                           = true,
+  };
+  // blend states can be dynamic, so blend configs share one pipeline
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+  };
+  if (check_device_extensions_support(_physical_device, { VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME }))
+  {
+    VkPhysicalDeviceFeatures2 supported_features2
+    {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &dynamic_state3_features,
+    };
+    vkGetPhysicalDeviceFeatures2(_physical_device, &supported_features2);
+    _dynamic_blend_supported = dynamic_state3_features.extendedDynamicState3ColorBlendEnable   &&
+                               dynamic_state3_features.extendedDynamicState3ColorBlendEquation &&
+                               dynamic_state3_features.extendedDynamicState3ColorWriteMask;
+  }
+  dynamic_state3_features =
+  {
+    .sType                                   = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+    .pNext                                   = &features12,
+    .extendedDynamicState3ColorBlendEnable   = _dynamic_blend_supported,
+    .extendedDynamicState3ColorBlendEquation = _dynamic_blend_supported,
+    .extendedDynamicState3ColorWriteMask     = _dynamic_blend_supported,
   };
+
+  // present fences tell when old swapchain can be destroyed
+  VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance_features
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT,
+  };
+  if (_surface_maintenance_supported &&
+      check_device_extensions_support(_physical_device, { VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME }))
+  {
+    VkPhysicalDeviceFeatures2 supported_features2
+    {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &swapchain_maintenance_features,
+    };
+    vkGetPhysicalDeviceFeatures2(_physical_device, &supported_features2);
+    _swapchain_maintenance_supported = swapchain_maintenance_features.swapchainMaintenance1;
+  }
+  swapchain_maintenance_features.pNext = _dynamic_blend_supported ? (void*)&dynamic_state3_features : &features12;
+
   VkPhysicalDeviceFeatures2 features2
   {
-    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-    .pNext = &features12
+    .sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext    = _swapchain_maintenance_supported ? (void*)&swapchain_maintenance_features :
+                _dynamic_blend_supported         ? (void*)&dynamic_state3_features        : &features12,
+    .features =
+    {
+      // present pass writes to swapchain image which format is unknown in shader
+      .shaderStorageImageWriteWithoutFormat   = _storage_write_without_format,
+      // mesh.frag indexes bindless textures by push constant
+      .shaderSampledImageArrayDynamicIndexing = true,
+      // hzb.comp indexes mips by push constant
+      .shaderStorageImageArrayDynamicIndexing = true,
+    },
   };
 
+  // extensions, optional extensions only enable when supported
+  auto extensions = Device_Extensions;
+  _display_timing_supported = check_device_extensions_support(_physical_device, { VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME });
+  if (_display_timing_supported)
+    extensions.emplace_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+  _memory_budget_supported = check_device_extensions_support(_physical_device, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+  if (_memory_budget_supported)
+    extensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (_dynamic_blend_supported)
+    extensions.emplace_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+  if (_swapchain_maintenance_supported)
+    extensions.emplace_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+
   // device info 
   VkDeviceCreateInfo create_info
   {
@@ -193,11 +304,11 @@ void GraphicsEngine::create_device_and_get_queues()
     .pNext = &features2,
     .queueCreateInfoCount = (uint32_t)queue_infos.size(),
     .pQueueCreateInfos = queue_infos.data(),
-    .enabledExtensionCount = (uint32_t)Device_Extensions.size(),
-    .ppEnabledExtensionNames = Device_Extensions.data(),
+    .enabledExtensionCount = (uint32_t)extensions.size(),
+    .ppEnabledExtensionNames = extensions.data(),
   };
 #ifndef NDEBUG
-  print_enabled_extensions("device", Device_Extensions);
+  print_enabled_extensions("device", extensions);
 #endif
 
   // create logical device
@@ -211,18 +322,38 @@ void GraphicsEngine::create_device_and_get_queues()
   //
   vkGetDeviceQueue(_device, queue_families.graphics_family.value(), 0, &_graphics_queue);
   vkGetDeviceQueue(_device, queue_families.present_family.value(), 0, &_present_queue);
+
+  //
+  // get optional extension functions
+  //
+  if (_display_timing_supported)
+    _vkGetPastPresentationTimingGOOGLE = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(_device, "vkGetPastPresentationTimingGOOGLE");
 }
     
 void GraphicsEngine::create_vma_allocator()
 {
+#ifdef TK_ALLOCATION_TRACKING
+  // device memory blocks are attributed to current allocation scope
+  static VmaDeviceMemoryCallbacks const Memory_Callbacks
+  {
+    .pfnAllocate = [](VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void*) { allocation_tracker::on_gpu_allocate(size); },
+    .pfnFree     = [](VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void*) { allocation_tracker::on_gpu_free(size);     },
+  };
+#endif
+
+  // without memory budget extension, vma estimates budget as 80% of heap size
   VmaAllocatorCreateInfo alloc_info
   {
-    .flags            = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT |
-                        VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
-    .physicalDevice   = _physical_device,
-    .device           = _device,
-    .instance         = _instance,
-    .vulkanApiVersion = Vulkan_Version,
+    .flags                  = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT |
+                              VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT   |
+                              (_memory_budget_supported ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u),
+    .physicalDevice         = _physical_device,
+    .device                 = _device,
+#ifdef TK_ALLOCATION_TRACKING
+    .pDeviceMemoryCallbacks = &Memory_Callbacks,
+#endif
+    .instance               = _instance,
+    .vulkanApiVersion       = Vulkan_Version,
   };
   throw_if(vmaCreateAllocator(&alloc_info, &_vma_allocator) != VK_SUCCESS,
            "failed to create Vulkan Memory Allocator");
@@ -230,6 +361,33 @@ void GraphicsEngine::create_vma_allocator()
   _destructors.push([this] { vmaDestroyAllocator(_vma_allocator); });
 }
 
+void GraphicsEngine::create_geometry_pool()
+{
+  // size isn't used to find memory type
+  VkBufferCreateInfo buffer_info
+  {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size  = 1024,
+    .usage = Geometry_Buffer_Usage,
+  };
+  VmaAllocationCreateInfo alloc_info
+  {
+    .usage = VMA_MEMORY_USAGE_AUTO,
+  };
+  uint32_t memory_type;
+  throw_if(vmaFindMemoryTypeIndexForBufferInfo(_vma_allocator, &buffer_info, &alloc_info, &memory_type) != VK_SUCCESS,
+           "failed to find memory type of geometry");
+
+  VmaPoolCreateInfo pool_info
+  {
+    .memoryTypeIndex = memory_type,
+  };
+  throw_if(vmaCreatePool(_vma_allocator, &pool_info, &_geometry_pool) != VK_SUCCESS,
+           "failed to create geometry pool");
+
+  _destructors.push([this] { vmaDestroyPool(_vma_allocator, _geometry_pool); });
+}
+
 void GraphicsEngine::create_swapchain_and_rendering_image()
 {
   //
@@ -247,11 +405,40 @@ void GraphicsEngine::create_swapchain_and_rendering_image()
   print_present_mode(present_mode);
   std::println("swapchain image counts: {}\n", image_count);
 #endif
+
+  // present pass can write swapchain image directly when it supports storage usage
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(_physical_device, details.get_surface_format().format, &format_properties);
+  _swapchain_storage = _storage_write_without_format                                          &&
+                       (details.capabilities.supportedUsageFlags  & VK_IMAGE_USAGE_STORAGE_BIT) &&
+                       (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
   create_swapchain();
 
   //
   // dynamic rendering use image
   //
+  // use screen size, so window resize in most cases not need to recreate it
+  create_rendering_image(extent);
+
+  _destructors.push([this]
+  {
+    for (auto view : _hzb_mip_views)
+      vkDestroyImageView(_device, view, nullptr);
+    destroy_image(_hzb);
+    destroy_image(_present_image);
+    destroy_image(_depth_image);
+    destroy_image(_image);
+    for (auto view : _swapchain_image_views)
+      vkDestroyImageView(_device, view, nullptr);
+    for (auto const& retired : _retired_swapchains)
+      vkDestroySwapchainKHR(_device, retired.swapchain, nullptr);
+    vkDestroySwapchainKHR(_device, _swapchain, nullptr);
+  });
+}
+
+void GraphicsEngine::create_rendering_image(VkExtent2D extent)
+{
   _image.extent = { extent.width, extent.height, 1 };
   _image.format = VK_FORMAT_R16G16B16A16_SFLOAT;
   
@@ -308,7 +495,8 @@ void GraphicsEngine::create_swapchain_and_rendering_image()
     .arrayLayers = 1,
     .samples     = VK_SAMPLE_COUNT_1_BIT,
     .tiling      = VK_IMAGE_TILING_OPTIMAL,
-    .usage       = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+    .usage       = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                   VK_IMAGE_USAGE_SAMPLED_BIT,
   };
   throw_if(vmaCreateImage(_vma_allocator, &depth_info, &alloc_info, &_depth_image.image, &_depth_image.allocation, nullptr) != VK_SUCCESS,
            "failed to create depth image");
@@ -328,14 +516,68 @@ void GraphicsEngine::create_swapchain_and_rendering_image()
   throw_if(vkCreateImageView(_device, &depth_view_info, nullptr, &_depth_image.view) != VK_SUCCESS,
            "failed to create depth image view");
 
-  _destructors.push([this]
+  //
+  // hierarchical depth buffer, full mip chain from half size of depth image,
+  // full view is sampled by cull pass and each mip is written by hzb pass.
+  //
+  _hzb.extent    = { std::max(1u, (extent.width + 1) / 2), std::max(1u, (extent.height + 1) / 2), 1 };
+  _hzb.format    = VK_FORMAT_R32_SFLOAT;
+  _hzb_mip_count = std::min(Max_Hzb_Mip_Count, (uint32_t)std::bit_width(std::max(_hzb.extent.width, _hzb.extent.height)));
+  _hzb_valid     = false;
+  VkImageCreateInfo hzb_info
   {
-    vkDestroyImageView(_device, _depth_image.view, nullptr);
-    vmaDestroyImage(_vma_allocator, _depth_image.image, _depth_image.allocation);
-    vkDestroyImageView(_device, _image.view, nullptr);
-    vmaDestroyImage(_vma_allocator, _image.image, _image.allocation);
-    vkDestroySwapchainKHR(_device, _swapchain, nullptr);
-  });
+    .sType       = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType   = VK_IMAGE_TYPE_2D,
+    .format      = _hzb.format,
+    .extent      = _hzb.extent,
+    .mipLevels   = _hzb_mip_count,
+    .arrayLayers = 1,
+    .samples     = VK_SAMPLE_COUNT_1_BIT,
+    .tiling      = VK_IMAGE_TILING_OPTIMAL,
+    .usage       = VK_IMAGE_USAGE_STORAGE_BIT |
+                   VK_IMAGE_USAGE_SAMPLED_BIT,
+  };
+  throw_if(vmaCreateImage(_vma_allocator, &hzb_info, &alloc_info, &_hzb.image, &_hzb.allocation, nullptr) != VK_SUCCESS,
+           "failed to create hzb image");
+  VkImageViewCreateInfo hzb_view_info
+  {
+    .sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image    = _hzb.image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format   = _hzb.format,
+    .subresourceRange =
+    {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = _hzb_mip_count,
+      .layerCount = 1,
+    },
+  };
+  throw_if(vkCreateImageView(_device, &hzb_view_info, nullptr, &_hzb.view) != VK_SUCCESS,
+           "failed to create hzb image view");
+  hzb_view_info.subresourceRange.levelCount = 1;
+  _hzb_mip_views.resize(_hzb_mip_count);
+  for (uint32_t i = 0; i < _hzb_mip_count; ++i)
+  {
+    hzb_view_info.subresourceRange.baseMipLevel = i;
+    throw_if(vkCreateImageView(_device, &hzb_view_info, nullptr, &_hzb_mip_views[i]) != VK_SUCCESS,
+             "failed to create hzb mip view");
+  }
+
+  //
+  // intermediate image of present pass when swapchain image can't be storage image,
+  // rgba8 is always supported as storage image, and blit converts it to swapchain format.
+  //
+  if (_storage_write_without_format && !_swapchain_storage)
+  {
+    _present_image.extent = _image.extent;
+    _present_image.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_info.format     = _present_image.format;
+    image_info.usage      = VK_IMAGE_USAGE_STORAGE_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    throw_if(vmaCreateImage(_vma_allocator, &image_info, &alloc_info, &_present_image.image, &_present_image.allocation, nullptr) != VK_SUCCESS,
+             "failed to create upscale image");
+    _present_image.view = create_image_view(_device, _present_image.image, _present_image.format);
+  }
 }
 
 void GraphicsEngine::create_swapchain(VkSwapchainKHR old_swapchain)
@@ -360,7 +602,8 @@ void GraphicsEngine::create_swapchain(VkSwapchainKHR old_swapchain)
     .imageExtent      = extent,
     .imageArrayLayers = 1,
     .imageUsage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-                        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT     |
+                        (_swapchain_storage ? VK_IMAGE_USAGE_STORAGE_BIT : 0u),
     .preTransform     = details.capabilities.currentTransform,
     .compositeAlpha   = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
     .presentMode      = present_mode,
@@ -394,6 +637,14 @@ void GraphicsEngine::create_swapchain(VkSwapchainKHR old_swapchain)
   _swapchain_images.resize(image_count);
   vkGetSwapchainImagesKHR(_device, _swapchain, &image_count, _swapchain_images.data());
   _swapchain_image_extent = extent;
+  _swapchain_format       = surface_format.format;
+  _swapchain_present_ids.assign(image_count, 0);
+
+  // views only used by present pass to write swapchain images
+  _swapchain_image_views.clear();
+  if (_swapchain_storage)
+    for (auto image : _swapchain_images)
+      _swapchain_image_views.emplace_back(create_image_view(_device, image, surface_format.format));
 }
 
 void GraphicsEngine::create_descriptor_set_layout()
@@ -419,6 +670,15 @@ void GraphicsEngine::create_descriptor_set_layout()
   _destructors.push([this] { vkDestroyDescriptorSetLayout(_device, _descriptor_set_layout, nullptr); });
 }
 
+void GraphicsEngine::create_pipeline_registry()
+{
+  // shader pack is next to executable, independent of working directory
+  auto base_path = SDL_GetBasePath();
+  throw_if(base_path == nullptr, "failed to get base path: {}", SDL_GetError());
+  _pipelines.init(_device, std::filesystem::path(base_path) / "shaders.pack", _dynamic_blend_supported);
+  _destructors.push([this] { _pipelines.destroy(); });
+}
+
 void GraphicsEngine::create_compute_pipeline()
 {
   _compute_pipeline_layout.resize(2);
@@ -438,49 +698,52 @@ void GraphicsEngine::create_compute_pipeline()
   {
     .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
     .offset     = 0,
-    .size       = sizeof(GeometryPushConstant),
+    .size       = sizeof(PushContant),
   };
   layout_info.pushConstantRangeCount = 1;
   layout_info.pPushConstantRanges    = &push_constant;
   throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_compute_pipeline_layout[1]) != VK_SUCCESS,
            "failed to create pipeline layout");
 
-  // create pipeline 
-  Shader shader0(_device, "build/compute.spv");
-  Shader shader1(_device, "build/gradient_color.spv");
-  VkComputePipelineCreateInfo pipeline_info
+  //
+  // workgroup size is chosen by device, a row of workgroup is filled by a subgroup,
+  // and workgroup has at least 64 invocations to hide latency.
+  //
+  VkPhysicalDeviceVulkan11Properties properties11
   {
-    .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-    .stage  =
-    {
-      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
-      .module = shader0.shader,
-      .pName = "main",
-    },
-    .layout = _compute_pipeline_layout[0],
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES,
+  };
+  VkPhysicalDeviceProperties2 properties
+  {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+    .pNext = &properties11,
   };
-  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_compute_pipeline[0]),
-           "failed to create compute pipeline");
-  pipeline_info.stage.module = shader1.shader;
-  pipeline_info.layout       = _compute_pipeline_layout[1];
-  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_compute_pipeline[1]),
-           "failed to create compute pipeline");
+  vkGetPhysicalDeviceProperties2(_physical_device, &properties);
+  auto const& limits      = properties.properties.limits;
+  auto        invocations = std::min(std::max(64u, properties11.subgroupSize), limits.maxComputeWorkGroupInvocations);
+  _background_group_size.width  = std::min({ properties11.subgroupSize, limits.maxComputeWorkGroupSize[0], invocations });
+  _background_group_size.height = std::clamp(invocations / _background_group_size.width, 1u, limits.maxComputeWorkGroupSize[1]);
+
+  // create pipeline 
+  auto builder = PipelineBuilder();
+  builder.set_constant(0, _background_group_size.width)
+         .set_constant(1, _background_group_size.height);
+  _compute_pipeline[0] = _pipelines.build(builder
+                                          .set_compute_shader(_pipelines.get_shader("compute"))
+                                          .get_key(_compute_pipeline_layout[0]));
+  _compute_pipeline[1] = _pipelines.build(builder
+                                          .set_compute_shader(_pipelines.get_shader("gradient_color"))
+                                          .get_key(_compute_pipeline_layout[1]));
 
   _destructors.push([this]
   { 
-    vkDestroyPipeline(_device, _compute_pipeline[0], nullptr);
     vkDestroyPipelineLayout(_device, _compute_pipeline_layout[0], nullptr);
-    vkDestroyPipeline(_device, _compute_pipeline[1], nullptr);
     vkDestroyPipelineLayout(_device, _compute_pipeline_layout[1], nullptr);
   });
 }
 
 void GraphicsEngine::create_graphics_pipeline()
 {
-  Shader vertex_shader(_device, "build/triangle_vert.spv");
-  Shader fragment_shader(_device, "build/triangle_frag.spv");
-
   VkPipelineLayoutCreateInfo layout_info
   {
     .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -489,109 +752,288 @@ void GraphicsEngine::create_graphics_pipeline()
            "failed to create graphics pipeline layout");
 
   auto builder = PipelineBuilder();
-  _graphics_pipeline = builder 
-                       .set_shaders(vertex_shader.shader, fragment_shader.shader)
+  _graphics_pipeline = _pipelines.build(builder 
+                       .set_shaders(_pipelines.get_shader("triangle_vert"), _pipelines.get_shader("triangle_frag"))
                        .set_cull_mode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE)
                        .set_color_attachment_format(_image.format)
-                       .build(_device, _graphics_pipeline_layout);
+                       .get_key(_graphics_pipeline_layout));
   
-  // create mesh pipeline
-  Shader mesh_vertex_shader(_device, "build/triangle_mesh_vert.spv");
+  // create mesh pipeline, fragment shader samples bindless textures
   VkPushConstantRange range
   {
-    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
     .size       = sizeof(GeometryPushConstant),
   };
+  layout_info.setLayoutCount         = 1;
+  layout_info.pSetLayouts            = &_texture_set_layout;
   layout_info.pPushConstantRanges    = &range;
   layout_info.pushConstantRangeCount = 1;
   throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_mesh_pipeline_layout) != VK_SUCCESS,
            "failed to create graphics pipeline layout");
-  _mesh_pipeline = builder
-                   .clear()
-                   .set_shaders(mesh_vertex_shader.shader, fragment_shader.shader)
-                   .set_cull_mode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE)
-                   .set_color_attachment_format(_image.format)
-                   .enable_depth_test(_depth_image.format)
-                   // .enable_additive_blending()
-                   .enable_alpha_blending()
-                   .build(_device, _mesh_pipeline_layout);
+  // cull, depth and blend are dynamic, so render states of mesh share one pipeline,
+  // without dynamic blend support blended one is another pipeline.
+  // it's drawn from first frame, so it's created now.
+  _mesh_pipeline_key = builder.clear()
+                       .set_shaders(_pipelines.get_shader("triangle_mesh_vert"), _pipelines.get_shader("mesh_frag"))
+                       .set_cull_mode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE)
+                       .set_color_attachment_format(_image.format)
+                       .enable_depth_test(_depth_image.format)
+                       .enable_dynamic_depth_cull()
+                       .enable_dynamic_blend()
+                       // .enable_additive_blending()
+                       .enable_alpha_blending()
+                       .get_key(_mesh_pipeline_layout);
+  _mesh_pipeline     = _pipelines.build(_mesh_pipeline_key);
 
   _destructors.push([this]
   { 
-    vkDestroyPipeline(_device, _graphics_pipeline, nullptr);
     vkDestroyPipelineLayout(_device, _graphics_pipeline_layout, nullptr);
-    vkDestroyPipeline(_device, _mesh_pipeline, nullptr);
     vkDestroyPipelineLayout(_device, _mesh_pipeline_layout, nullptr);
   });
 }
 
-void GraphicsEngine::create_command_pool()
+void GraphicsEngine::create_present_pipelines()
 {
-  // create command pool
-  auto queue_families = get_queue_family_indices(_physical_device, _surface);
-  VkCommandPoolCreateInfo command_pool_info
+  if (!_storage_write_without_format)
+    return;
+
+  // input is draw image, output is swapchain image or intermediate image,
+  // both upscale and present pipelines use same layout
+  std::vector<VkDescriptorSetLayoutBinding> bindings
   {
-    .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-    .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-    .queueFamilyIndex = queue_families.graphics_family.value(),
+    {
+      .binding         = 0,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+    {
+      .binding         = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
   };
-  throw_if(vkCreateCommandPool(_device, &command_pool_info, nullptr, &_command_pool) != VK_SUCCESS,
-           "failed to create command pool");
+  VkDescriptorSetLayoutCreateInfo set_layout_info
+  {
+    .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = (uint32_t)bindings.size(),
+    .pBindings    = bindings.data(),
+  };
+  throw_if(vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_present_set_layout) != VK_SUCCESS,
+           "failed to create descriptor set layout");
 
-  _destructors.push([this] { vkDestroyCommandPool(_device, _command_pool, nullptr); });
+  VkPushConstantRange push_constant
+  {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .size       = sizeof(PresentPushConstant),
+  };
+  VkPipelineLayoutCreateInfo layout_info
+  {
+    .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount         = 1,
+    .pSetLayouts            = &_present_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges    = &push_constant,
+  };
+  throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_present_pipeline_layout) != VK_SUCCESS,
+           "failed to create pipeline layout");
+
+  // upscale pipeline is used when draw extent smaller than swapchain extent,
+  // otherwise present pipeline only do output transform.
+  auto upscale_shader = _pipelines.get_shader("upscale");
+  auto present_shader = _pipelines.get_shader("present");
+  VkComputePipelineCreateInfo pipeline_info
+  {
+    .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage  =
+    {
+      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = upscale_shader,
+      .pName  = "main",
+    },
+    .layout = _present_pipeline_layout,
+  };
+  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_upscale_pipeline) != VK_SUCCESS,
+           "failed to create upscale pipeline");
+  pipeline_info.stage.module = present_shader;
+  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_present_pipeline) != VK_SUCCESS,
+           "failed to create present pipeline");
+
+  _destructors.push([this]
+  {
+    vkDestroyPipeline(_device, _upscale_pipeline, nullptr);
+    vkDestroyPipeline(_device, _present_pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _present_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _present_set_layout, nullptr);
+  });
 }
 
-void GraphicsEngine::create_descriptor_pool()
+void GraphicsEngine::create_cull_pipelines()
 {
-  std::vector<VkDescriptorPoolSize> sizes
+  // depth and hzb are read by texelFetch, filter is not used
+  VkSamplerCreateInfo sampler_info
   {
+    .sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter    = VK_FILTER_NEAREST,
+    .minFilter    = VK_FILTER_NEAREST,
+    .mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .maxLod       = VK_LOD_CLAMP_NONE,
+  };
+  throw_if(vkCreateSampler(_device, &sampler_info, nullptr, &_hzb_sampler) != VK_SUCCESS,
+           "failed to create hzb sampler");
+
+  //
+  // hzb pass reads depth image and writes hzb mips,
+  // cull pass reads full hzb, both use same set layout
+  //
+  std::vector<VkDescriptorSetLayoutBinding> bindings
+  {
+    {
+      .binding         = 0,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+    {
+      .binding         = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = Max_Hzb_Mip_Count,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
     {
-      .type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .binding         = 2,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
       .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
     },
   };
-  VkDescriptorPoolCreateInfo info
+  VkDescriptorSetLayoutCreateInfo set_layout_info
   {
-    .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-    .maxSets       = 1,
-    .poolSizeCount = (uint32_t)sizes.size(),
-    .pPoolSizes    = sizes.data(),
+    .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = (uint32_t)bindings.size(),
+    .pBindings    = bindings.data(),
   };
-  throw_if(vkCreateDescriptorPool(_device, &info, nullptr, &_descriptor_pool) != VK_SUCCESS,
-           "failed to create descriptor pool");
-  
-  _destructors.push([this] { vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr); });
-}
+  throw_if(vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_hzb_set_layout) != VK_SUCCESS,
+           "failed to create descriptor set layout");
 
-void GraphicsEngine::create_descriptor_sets()
-{
-  VkDescriptorSetAllocateInfo info
+  VkPushConstantRange push_constant
+  {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .size       = sizeof(HzbPushConstant),
+  };
+  VkPipelineLayoutCreateInfo layout_info
   {
-    .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-    .descriptorPool     = _descriptor_pool,
-    .descriptorSetCount = 1,
-    .pSetLayouts        = &_descriptor_set_layout,
+    .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount         = 1,
+    .pSetLayouts            = &_hzb_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges    = &push_constant,
   };
-  throw_if(vkAllocateDescriptorSets(_device, &info, &_descriptor_set) != VK_SUCCESS,
-           "failed to create descriptor set");
+  throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_hzb_pipeline_layout) != VK_SUCCESS,
+           "failed to create pipeline layout");
+  push_constant.size = sizeof(CullPushConstant);
+  throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_cull_pipeline_layout) != VK_SUCCESS,
+           "failed to create pipeline layout");
 
-  VkDescriptorImageInfo img_info
+  auto hzb_shader  = _pipelines.get_shader("hzb");
+  auto cull_shader = _pipelines.get_shader("cull");
+  VkComputePipelineCreateInfo pipeline_info
   {
-    .imageView   = _image.view,
-    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage  =
+    {
+      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = hzb_shader,
+      .pName  = "main",
+    },
+    .layout = _hzb_pipeline_layout,
   };
+  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_hzb_pipeline) != VK_SUCCESS,
+           "failed to create hzb pipeline");
+  pipeline_info.stage.module = cull_shader;
+  pipeline_info.layout       = _cull_pipeline_layout;
+  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_cull_pipeline) != VK_SUCCESS,
+           "failed to create cull pipeline");
+
+  _destructors.push([this]
+  {
+    vkDestroyPipeline(_device, _hzb_pipeline, nullptr);
+    vkDestroyPipeline(_device, _cull_pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _hzb_pipeline_layout, nullptr);
+    vkDestroyPipelineLayout(_device, _cull_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _hzb_set_layout, nullptr);
+    vkDestroySampler(_device, _hzb_sampler, nullptr);
+  });
+}
 
-  VkWriteDescriptorSet write
+void GraphicsEngine::create_command_pool()
+{
+  // create command pool
+  auto queue_families = get_queue_family_indices(_physical_device, _surface);
+  VkCommandPoolCreateInfo command_pool_info
   {
-    .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-    .dstSet          = _descriptor_set,
-    .dstBinding      = 0,
-    .descriptorCount = 1,
-    .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-    .pImageInfo     = &img_info,
+    .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = queue_families.graphics_family.value(),
   };
+  throw_if(vkCreateCommandPool(_device, &command_pool_info, nullptr, &_command_pool) != VK_SUCCESS,
+           "failed to create command pool");
+
+  _destructors.push([this] { vkDestroyCommandPool(_device, _command_pool, nullptr); });
+}
+
+void GraphicsEngine::create_descriptor_allocators()
+{
+  // each frame has a present set which has two storage images,
+  // and a hzb set which has two samplers and storage images of hzb mips.
+  // pools grow when post processing or compute passes need more.
+  std::array<DescriptorAllocator::PoolRatio, 4> frame_ratios
+  {{
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          (2.f + Max_Hzb_Mip_Count) / 2 },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f                           },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1.f                           },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1.f                           },
+  }};
+  for (auto& frame : _frames)
+    frame.descriptors.init(_device, 4, frame_ratios);
+
+  std::array<DescriptorAllocator::PoolRatio, 4> cache_ratios
+  {{
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1.f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1.f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1.f },
+  }};
+  _descriptor_cache.init(_device, cache_ratios);
+
+  _destructors.push([this]
+  {
+    _descriptor_cache.destroy();
+    for (auto& frame : _frames)
+      frame.descriptors.destroy();
+  });
+}
 
-  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+void GraphicsEngine::create_descriptor_sets()
+{
+  // set of offscreen image is shared until image recreated
+  DescriptorCache::Binding binding
+  {
+    .binding = 0,
+    .type    = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    .image   =
+    {
+      .imageView   = _image.view,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+  };
+  _descriptor_set = _descriptor_cache.get(_descriptor_set_layout, { &binding, 1 });
 }
 
 void GraphicsEngine::create_frame_resources()
@@ -627,6 +1069,19 @@ void GraphicsEngine::create_frame_resources()
              vkCreateSemaphore(_device, &sem_info, nullptr, &frame.image_available_sem) != VK_SUCCESS || 
              vkCreateSemaphore(_device, &sem_info, nullptr, &frame.render_finished_sem) != VK_SUCCESS,
              "faield to create sync objects");
+  if (_swapchain_maintenance_supported)
+    for (auto& frame : _frames)
+      throw_if(vkCreateFence(_device, &fence_info, nullptr, &frame.present_fence) != VK_SUCCESS,
+               "failed to create present fence");
+
+  VkSemaphoreTypeCreateInfo timeline_info
+  {
+    .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+  };
+  sem_info.pNext = &timeline_info;
+  throw_if(vkCreateSemaphore(_device, &sem_info, nullptr, &_frame_timeline) != VK_SUCCESS,
+           "failed to create frame timeline");
 
   _destructors.push([&]
   {
@@ -635,22 +1090,254 @@ void GraphicsEngine::create_frame_resources()
       vkDestroyFence(_device, frame.fence, nullptr);
       vkDestroySemaphore(_device, frame.image_available_sem, nullptr);
       vkDestroySemaphore(_device, frame.render_finished_sem, nullptr);
+      // device idle doesn't wait presents
+      if (frame.present_fence != VK_NULL_HANDLE)
+      {
+        vkWaitForFences(_device, 1, &frame.present_fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(_device, frame.present_fence, nullptr);
+      }
     }
+    vkDestroySemaphore(_device, _frame_timeline, nullptr);
   });
 }
 
+void GraphicsEngine::create_frame_data_buffers()
+{
+  //
+  // host coherent so writes are visible at submit without flush.
+  // prefer device local host visible memory (BAR, or all VRAM with ReBAR),
+  // shaders read it without crossing PCIe, otherwise it falls back to system memory.
+  //
+  VkBufferCreateInfo buffer_info
+  {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size  = Frame_Data_Size,
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+  };
+  VmaAllocationCreateInfo alloc_info
+  {
+    .flags          = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .usage          = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+    .requiredFlags  = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  for (auto& frame : _frames)
+  {
+    auto& frame_data = frame.frame_data;
+    VmaAllocationInfo info;
+    throw_if(vmaCreateBuffer(_vma_allocator, &buffer_info, &alloc_info, &frame_data.buffer.buffer, &frame_data.buffer.allocation, &info) != VK_SUCCESS,
+             "failed to create frame data buffer");
+    frame_data.buffer.size = Frame_Data_Size;
+    frame_data.data        = static_cast<std::byte*>(info.pMappedData);
+    frame_data.address     = get_buffer_address(frame_data.buffer.buffer);
+  }
+
+  //
+  // stage buffers are reused by texture streaming of each frame instead of created per upload,
+  // they are only read by copies, so system memory is enough.
+  //
+  buffer_info.size          = Texture_Stage_Size;
+  buffer_info.usage         = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  alloc_info.usage          = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+  alloc_info.preferredFlags = 0;
+  for (auto& frame : _frames)
+  {
+    auto& stage = frame.texture_stage;
+    VmaAllocationInfo info;
+    throw_if(vmaCreateBuffer(_vma_allocator, &buffer_info, &alloc_info, &stage.buffer.buffer, &stage.buffer.allocation, &info) != VK_SUCCESS,
+             "failed to create texture stage buffer");
+    stage.buffer.size = Texture_Stage_Size;
+    stage.data        = static_cast<std::byte*>(info.pMappedData);
+  }
+
+  _destructors.push([this]
+  {
+    for (auto& frame : _frames)
+    {
+      frame.frame_data.buffer.destroy(_vma_allocator);
+      frame.texture_stage.buffer.destroy(_vma_allocator);
+    }
+  });
+}
+
+void GraphicsEngine::create_query_pool()
+{
+  // timestamps may not be supported by graphics queue, then dynamic resolution is disabled
+  auto queue_families = get_queue_family_indices(_physical_device, _surface);
+  auto valid_bits     = get_supported_queue_families(_physical_device)[queue_families.graphics_family.value()].timestampValidBits;
+  if (valid_bits == 0)
+    return;
+  _timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(_physical_device, &properties);
+  _timestamp_period = properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo info
+  {
+    .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+    .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+    .queryCount = Max_Frame_Number * 2,
+  };
+  throw_if(vkCreateQueryPool(_device, &info, nullptr, &_query_pool) != VK_SUCCESS,
+           "failed to create query pool");
+
+  _destructors.push([this] { vkDestroyQueryPool(_device, _query_pool, nullptr); });
+}
+
 void GraphicsEngine::upload_data()
 {
   _mesh_buffer = create_mesh_buffer(Vertices, Indices);
+  register_mesh_buffer(_mesh_buffer);
   _destructors.push([&] { _mesh_buffer.destroy(_vma_allocator); });
 }
 
+void GraphicsEngine::create_cull_buffers()
+{
+  // sized for meshs loaded at init, grown by poll_meshs() when more are loaded
+  auto [index_count, draw_count] = get_cull_counts();
+  for (auto& frame : _frames)
+    reserve_cull_buffers(frame, index_count, draw_count);
+
+  _destructors.push([this]
+  {
+    for (auto& frame : _frames)
+    {
+      frame.cull_indices.destroy(_vma_allocator);
+      frame.cull_draw.destroy(_vma_allocator);
+    }
+  });
+}
+
+//
+// compacted indices of a surface never more than its full detail indices,
+// they are compacted in same range, and meshs use consecutive ranges.
+//
+auto GraphicsEngine::get_cull_counts() const -> std::pair<uint32_t, uint32_t>
+{
+  uint32_t index_count = 0;
+  uint32_t draw_count  = 0;
+  for (auto const& mesh : _meshs)
+  {
+    if (mesh->mesh_buffer.meshlet_address == 0)
+      continue;
+    index_count += get_cull_index_count(*mesh);
+    draw_count  += mesh->surfaces.size();
+  }
+  return { index_count, draw_count };
+}
+
+auto GraphicsEngine::get_cull_index_count(MeshAsset const& mesh) -> uint32_t
+{
+  uint32_t count = 0;
+  for (auto const& surface : mesh.surfaces)
+    count = std::max(count, surface.start_index + surface.count);
+  return count;
+}
+
+// buffers only grow, old ones are destroyed after frames using them finished
+void GraphicsEngine::reserve_cull_buffers(FrameResource& frame, uint32_t index_count, uint32_t draw_count)
+{
+  if (frame.cull_indices.size < std::max(1u, index_count) * sizeof(uint32_t))
+  {
+    if (frame.cull_indices.buffer != VK_NULL_HANDLE)
+      defer_destroy(frame.cull_indices);
+    frame.cull_indices = create_buffer(std::max(1u, index_count) * sizeof(uint32_t),
+                                       VK_BUFFER_USAGE_INDEX_BUFFER_BIT   |
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  }
+  if (frame.cull_draw.size < std::max(1u, draw_count) * sizeof(CullDrawCommand))
+  {
+    if (frame.cull_draw.buffer != VK_NULL_HANDLE)
+      defer_destroy(frame.cull_draw);
+    frame.cull_draw    = create_buffer(std::max(1u, draw_count) * sizeof(CullDrawCommand),
+                                       VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT  |
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT    |
+                                       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  }
+}
+
 void GraphicsEngine::resize_swapchain()
 {
-  vkDeviceWaitIdle(_device);
+  auto allow_heap = AllowHeapScope();
+
+  //
+  // not need to wait device idle, old swapchain is retired by create_swapchain.
+  // its views are destroyed when frames which may use them are finished,
+  // and itself when presents to it are finished, which frames finished don't tell.
+  //
   auto old_swapchain = _swapchain;
+  auto old_views     = std::move(_swapchain_image_views);
   create_swapchain(old_swapchain);
-  vkDestroySwapchainKHR(_device, old_swapchain, nullptr);
+  for (auto view : old_views)
+    defer_destroy(view);
+  _retired_swapchains.push_back({ old_swapchain, _present_id });
+
+  //
+  // offscreen images only need to be recreated when window is bigger than them,
+  // otherwise just draw part of them.
+  //
+  if (_swapchain_image_extent.width  <= _image.extent.width &&
+      _swapchain_image_extent.height <= _image.extent.height)
+    return;
+
+  for (auto view : _hzb_mip_views)
+    defer_destroy(view);
+  _hzb_mip_views.clear();
+  for (auto const& image : { _hzb, _present_image, _depth_image, _image })
+    defer_destroy(image);
+  // sets of old offscreen image are reused after frames using them finished
+  _descriptor_cache.evict(_image.view, [this](auto layout, auto set)
+  {
+    defer_destroy([this, layout, set] { _descriptor_cache.recycle(layout, set); });
+  });
+
+  // reserve more space to avoid recreate images every frame when dragging window
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(_physical_device, &properties);
+  auto max_dimension = properties.limits.maxImageDimension2D;
+  create_rendering_image(
+  {
+    std::min(max_dimension, std::max(_image.extent.width,  _swapchain_image_extent.width  + _swapchain_image_extent.width  / 4)),
+    std::min(max_dimension, std::max(_image.extent.height, _swapchain_image_extent.height + _swapchain_image_extent.height / 4)),
+  });
+  create_descriptor_sets();
+}
+
+//
+// presents finish in order, so retired swapchains whose last present is not after it are not used.
+// with swapchain maintenance, a present is known finished when its present fence is signaled,
+// otherwise when its image is acquired again and the frame waiting that acquire finished.
+//
+void GraphicsEngine::on_present_finished(uint32_t present_id)
+{
+  _finished_present_id = std::max(_finished_present_id, present_id);
+  std::erase_if(_retired_swapchains, [this](auto const& retired)
+  {
+    if (retired.last_present_id > _finished_present_id)
+      return false;
+    vkDestroySwapchainKHR(_device, retired.swapchain, nullptr);
+    return true;
+  });
+}
+
+void GraphicsEngine::wait_frames_finished()
+{
+  for (auto& frame : _frames)
+    throw_if(vkWaitForFences(_device, 1, &frame.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS,
+             "failed to wait fence");
+  collect_garbage();
+}
+
+auto GraphicsEngine::collect_garbage() -> uint64_t
+{
+  uint64_t completed_serial;
+  throw_if(vkGetSemaphoreCounterValue(_device, _frame_timeline, &completed_serial) != VK_SUCCESS,
+           "failed to get frame timeline value");
+  _deletion_queue.collect(completed_serial, _device, _vma_allocator);
+  return completed_serial;
 }
 
 } }
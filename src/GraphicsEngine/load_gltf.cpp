@@ -1,18 +1,66 @@
 #include "GraphicsEngine.hpp"
-#include "gltf.hpp"
+#include "AllocationTracker.hpp"
 
 namespace tk { namespace graphics_engine {
 
 void GraphicsEngine::load_gltf()
 {
-  _meshs = graphics_engine::load_gltf(this, "asset/monkey.glb");
-  _destructors.push([&]
-  { 
-    for (auto& d : _meshs)
-    {
-      d->mesh_buffer.destroy(_vma_allocator);
-    }
+  auto allocation_scope = AllocationScope("load_gltf");
+
+  // meshs are drawn once uploaded by poll_meshs()
+  _mesh_request = _mesh_registry.load_async("asset/monkey.glb");
+
+  // buffers of released meshs are deferred, destroy them before allocator
+  _destructors.push([this]
+  {
+    _mesh_request.reset();
+    _meshs.clear();
+    _residency.clear();
+    _mesh_registry.clear();
+    _deletion_queue.flush(_device, _vma_allocator);
   });
 }
 
+void GraphicsEngine::poll_meshs()
+{
+  _mesh_registry.poll();
+  if (!_mesh_request || _mesh_request->status == MeshRequest::Status::Loading)
+    return;
+
+  if (_mesh_request->status == MeshRequest::Status::Ready)
+  {
+    _meshs = std::move(_mesh_request->meshs);
+
+    // cull buffers grow here instead of in cull pass, old ones are destroyed after frames using them finished
+    auto [index_count, draw_count] = get_cull_counts();
+    for (auto& frame : _frames)
+      reserve_cull_buffers(frame, index_count, draw_count);
+  }
+  _mesh_request.reset();
+}
+
+void GraphicsEngine::destroy_mesh_buffer(MeshBuffer const& mesh_buffer)
+{
+  // defragmentation doesn't move released buffers
+  for (auto allocation : { mesh_buffer.vertices.allocation, mesh_buffer.indices.allocation, mesh_buffer.meshlets.allocation })
+    if (allocation != VK_NULL_HANDLE)
+      vmaSetAllocationUserData(_vma_allocator, allocation, nullptr);
+
+  if (_defrag_serial != 0)
+    _defrag_released.emplace_back(mesh_buffer);
+  else
+  {
+    defer_destroy(mesh_buffer.vertices);
+    defer_destroy(mesh_buffer.indices);
+    defer_destroy(mesh_buffer.meshlets);
+  }
+}
+
+void GraphicsEngine::register_mesh_buffer(MeshBuffer& mesh_buffer)
+{
+  for (auto allocation : { mesh_buffer.vertices.allocation, mesh_buffer.indices.allocation, mesh_buffer.meshlets.allocation })
+    if (allocation != VK_NULL_HANDLE)
+      vmaSetAllocationUserData(_vma_allocator, allocation, &mesh_buffer);
+}
+
 } }
@@ -0,0 +1,716 @@
+#include "GraphicsEngine.hpp"
+#include "init-util.hpp"
+#include "ShaderStructs.hpp"
+#include "ErrorHandling.hpp"
+#include "Log.hpp"
+#include "HeapGuard.hpp"
+#include "MeshCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace tk { namespace graphics_engine {
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Initialize
+////////////////////////////////////////////////////////////////////////////////
+
+void GraphicsEngine::create_texture_resources()
+{
+  // trilinear and repeat, lod is clamped by shader to resident mips
+  VkSamplerCreateInfo sampler_info
+  {
+    .sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter    = VK_FILTER_LINEAR,
+    .minFilter    = VK_FILTER_LINEAR,
+    .mipmapMode   = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .maxLod       = VK_LOD_CLAMP_NONE,
+  };
+  throw_if(vkCreateSampler(_device, &sampler_info, nullptr, &_texture_sampler) != VK_SUCCESS,
+           "failed to create texture sampler");
+
+  //
+  // bindless texture array, slots are written when textures are created,
+  // and slots not used by frames in flight can be written while they are pending
+  //
+  VkDescriptorSetLayoutBinding binding
+  {
+    .binding         = 0,
+    .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .descriptorCount = Max_Texture_Count,
+    .stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT,
+  };
+  VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT           |
+                                           VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT         |
+                                           VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info
+  {
+    .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+    .bindingCount  = 1,
+    .pBindingFlags = &binding_flags,
+  };
+  VkDescriptorSetLayoutCreateInfo set_layout_info
+  {
+    .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .pNext        = &flags_info,
+    .flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+    .bindingCount = 1,
+    .pBindings    = &binding,
+  };
+  throw_if(vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_texture_set_layout) != VK_SUCCESS,
+           "failed to create texture set layout");
+
+  VkDescriptorPoolSize pool_size
+  {
+    .type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .descriptorCount = Max_Texture_Count,
+  };
+  VkDescriptorPoolCreateInfo pool_info
+  {
+    .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+    .maxSets       = 1,
+    .poolSizeCount = 1,
+    .pPoolSizes    = &pool_size,
+  };
+  throw_if(vkCreateDescriptorPool(_device, &pool_info, nullptr, &_texture_pool) != VK_SUCCESS,
+           "failed to create texture descriptor pool");
+
+  VkDescriptorSetAllocateInfo set_info
+  {
+    .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool     = _texture_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts        = &_texture_set_layout,
+  };
+  throw_if(vkAllocateDescriptorSets(_device, &set_info, &_texture_set) != VK_SUCCESS,
+           "failed to create texture descriptor set");
+
+  // lower indices are allocated first
+  _free_texture_indices.resize(Max_Texture_Count);
+  for (uint32_t i = 0; i < Max_Texture_Count; ++i)
+    _free_texture_indices[i] = Max_Texture_Count - 1 - i;
+
+  //
+  // mip generation reads previous mip and writes next one,
+  // descriptors are pushed per mip so no set is allocated
+  //
+  std::vector<VkDescriptorSetLayoutBinding> bindings
+  {
+    {
+      .binding         = 0,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+    {
+      .binding         = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+  };
+  VkDescriptorSetLayoutCreateInfo mipgen_set_layout_info
+  {
+    .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT,
+    .bindingCount = (uint32_t)bindings.size(),
+    .pBindings    = bindings.data(),
+  };
+  throw_if(vkCreateDescriptorSetLayout(_device, &mipgen_set_layout_info, nullptr, &_mipgen_set_layout) != VK_SUCCESS,
+           "failed to create mipgen set layout");
+
+  VkPushConstantRange push_constant
+  {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .size       = sizeof(MipgenPushConstant),
+  };
+  VkPipelineLayoutCreateInfo layout_info
+  {
+    .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount         = 1,
+    .pSetLayouts            = &_mipgen_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges    = &push_constant,
+  };
+  throw_if(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_mipgen_pipeline_layout) != VK_SUCCESS,
+           "failed to create pipeline layout");
+
+  auto mipgen_shader = _pipelines.get_shader("mipgen");
+  VkComputePipelineCreateInfo pipeline_info
+  {
+    .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage  =
+    {
+      .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = mipgen_shader,
+      .pName  = "main",
+    },
+    .layout = _mipgen_pipeline_layout,
+  };
+  throw_if(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_mipgen_pipeline) != VK_SUCCESS,
+           "failed to create mipgen pipeline");
+
+  _destructors.push([this]
+  {
+    vkDestroyPipeline(_device, _mipgen_pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _mipgen_pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _mipgen_set_layout, nullptr);
+    vkDestroyDescriptorPool(_device, _texture_pool, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _texture_set_layout, nullptr);
+    vkDestroySampler(_device, _texture_sampler, nullptr);
+  });
+}
+
+void GraphicsEngine::create_default_texture()
+{
+  // white texture is sampled by surfaces without texture and textures not resident yet,
+  // so it is cleared at once instead of streamed
+  _default_texture = allocate_texture();
+  create_texture_image(*_default_texture, 1, 1);
+
+  auto cmd = begin_single_time_commands();
+  transition_image_layout(cmd, _default_texture->image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  VkClearColorValue       white = { .float32 = { 1.f, 1.f, 1.f, 1.f } };
+  VkImageSubresourceRange range = get_image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+  vkCmdClearColorImage(cmd, _default_texture->image.image, VK_IMAGE_LAYOUT_GENERAL, &white, 1, &range);
+  end_single_time_commands(cmd);
+  _default_texture->resident_mip = 0;
+
+  // released textures are pushed to frames, destroy them before texture resources
+  _destructors.push([this]
+  {
+    _texture_decodes.clear();
+    _texture_promotions.clear();
+    _promoted_textures.clear();
+    _streaming_textures.clear();
+    _textures.clear();
+    _default_texture.reset();
+    _deletion_queue.flush(_device, _vma_allocator);
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Texture
+////////////////////////////////////////////////////////////////////////////////
+
+auto GraphicsEngine::allocate_texture() -> std::shared_ptr<Texture>
+{
+  throw_if(_free_texture_indices.empty(), "too many textures, max is {}", Max_Texture_Count);
+  auto texture   = new Texture();
+  texture->index = _free_texture_indices.back();
+  _free_texture_indices.pop_back();
+  return std::shared_ptr<Texture>(texture, [this](Texture* texture) { destroy_texture(texture); });
+}
+
+void GraphicsEngine::destroy_texture(Texture* texture)
+{
+  // image and index are released after frames which may sample it finished
+  for (auto view : texture->mip_views)
+    defer_destroy(view);
+  defer_destroy(texture->image);
+  defer_destroy([this, index = texture->index] { _free_texture_indices.push_back(index); });
+  delete texture;
+}
+
+auto GraphicsEngine::load_texture(std::filesystem::path const& path) -> std::shared_ptr<Texture>
+{
+  auto texture = allocate_texture();
+  _residency.track(texture);
+  _texture_decodes.emplace_back(TextureDecode
+  {
+    .texture = texture,
+    .data    = std::async(std::launch::async, load_image, path),
+  });
+  return texture;
+}
+
+auto GraphicsEngine::create_texture(ImageData&& data) -> std::shared_ptr<Texture>
+{
+  if (auto it = _textures.find(data.hash); it != _textures.end())
+    if (auto texture = it->second.lock())
+      return texture;
+
+  auto texture  = allocate_texture();
+  texture->data = std::move(data);
+  _textures[texture->data.hash] = texture;
+  _residency.track(texture);
+  _streaming_textures.emplace_back(texture);
+  return texture;
+}
+
+//
+// image is unorm for storage writes of mip generation,
+// sampled view reinterprets it as sRGB
+//
+void GraphicsEngine::create_texture_image(Texture& texture, uint32_t width, uint32_t height)
+{
+  auto& image       = texture.image;
+  image.extent      = { width, height, 1 };
+  image.format      = VK_FORMAT_R8G8B8A8_SRGB;
+  texture.mip_count = std::bit_width(std::max(width, height));
+
+  VkImageCreateInfo image_info
+  {
+    .sType       = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .flags       = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT,
+    .imageType   = VK_IMAGE_TYPE_2D,
+    .format      = VK_FORMAT_R8G8B8A8_UNORM,
+    .extent      = image.extent,
+    .mipLevels   = texture.mip_count,
+    .arrayLayers = 1,
+    .samples     = VK_SAMPLE_COUNT_1_BIT,
+    .tiling      = VK_IMAGE_TILING_OPTIMAL,
+    .usage       = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                   VK_IMAGE_USAGE_STORAGE_BIT      |
+                   VK_IMAGE_USAGE_SAMPLED_BIT,
+  };
+  VmaAllocationCreateInfo alloc_info
+  {
+    .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+  };
+  auto res = vmaCreateImage(_vma_allocator, &image_info, &alloc_info, &image.image, &image.allocation, nullptr);
+  if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY)
+  {
+    reclaim_memory();
+    res = vmaCreateImage(_vma_allocator, &image_info, &alloc_info, &image.image, &image.allocation, nullptr);
+  }
+  throw_if(res != VK_SUCCESS, "failed to create texture image");
+
+  // sRGB format doesn't support storage usage, so restrict usage of sampled view
+  VkImageViewUsageCreateInfo usage_info
+  {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+  };
+  VkImageViewCreateInfo view_info
+  {
+    .sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .pNext    = &usage_info,
+    .image    = image.image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format   = image.format,
+    .subresourceRange =
+    {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = texture.mip_count,
+      .layerCount = 1,
+    },
+  };
+  throw_if(vkCreateImageView(_device, &view_info, nullptr, &image.view) != VK_SUCCESS,
+           "failed to create texture image view");
+
+  view_info.pNext                       = nullptr;
+  view_info.format                      = VK_FORMAT_R8G8B8A8_UNORM;
+  view_info.subresourceRange.levelCount = 1;
+  texture.mip_views.resize(texture.mip_count);
+  for (uint32_t i = 0; i < texture.mip_count; ++i)
+  {
+    view_info.subresourceRange.baseMipLevel = i;
+    throw_if(vkCreateImageView(_device, &view_info, nullptr, &texture.mip_views[i]) != VK_SUCCESS,
+             "failed to create texture mip view");
+  }
+
+  // slot is not used by any frame in flight, it was released after they finished
+  VkDescriptorImageInfo image_desc
+  {
+    .sampler     = _texture_sampler,
+    .imageView   = image.view,
+    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+  };
+  VkWriteDescriptorSet write
+  {
+    .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet          = _texture_set,
+    .dstBinding      = 0,
+    .dstArrayElement = texture.index,
+    .descriptorCount = 1,
+    .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .pImageInfo      = &image_desc,
+  };
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+}
+
+auto GraphicsEngine::get_texture_binding(Texture const* texture) const -> std::pair<uint32_t, float>
+{
+  if (texture == nullptr || !texture->resident())
+    return { _default_texture->index, 0.f };
+  return { texture->index, (float)texture->resident_mip };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Streaming
+////////////////////////////////////////////////////////////////////////////////
+
+void GraphicsEngine::generate_mips(VkCommandBuffer cmd, Texture const& texture, uint32_t begin, uint32_t end)
+{
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _mipgen_pipeline);
+  for (auto level = begin; level < end; ++level)
+  {
+    std::array<VkDescriptorImageInfo, 2> infos
+    {{
+      { .imageView = texture.mip_views[level - 1], .imageLayout = VK_IMAGE_LAYOUT_GENERAL },
+      { .imageView = texture.mip_views[level],     .imageLayout = VK_IMAGE_LAYOUT_GENERAL },
+    }};
+    std::array<VkWriteDescriptorSet, 2> writes;
+    for (uint32_t i = 0; i < writes.size(); ++i)
+      writes[i] =
+      {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding      = i,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo      = &infos[i],
+      };
+    vkCmdPushDescriptorSet(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _mipgen_pipeline_layout, 0, (uint32_t)writes.size(), writes.data());
+
+    auto extent = texture.image.extent;
+    MipgenPushConstant push_constant
+    {
+      .src_size = glm::max(glm::ivec2(1), glm::ivec2(extent.width >> (level - 1), extent.height >> (level - 1))),
+      .dst_size = glm::max(glm::ivec2(1), glm::ivec2(extent.width >> level,       extent.height >> level)),
+    };
+    vkCmdPushConstants(cmd, _mipgen_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constant), &push_constant);
+    vkCmdDispatch(cmd, std::ceil(push_constant.dst_size.x / 8.f), std::ceil(push_constant.dst_size.y / 8.f), 1);
+
+    memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  }
+}
+
+// image file or image embedded in gltf
+static auto reload_image(ImageSource const& source) -> ImageData
+{
+  if (source.gltf_image == ~0u)
+    return load_image(source.path);
+  return load_gltf_image(source.path, source.gltf_image);
+}
+
+//
+// decodes finished on workers begin streaming, and images of new textures are created.
+// it allocates, so it's called by update() before hot path of frame.
+//
+void GraphicsEngine::poll_textures()
+{
+  // texture may be released while decoding
+  std::erase_if(_texture_decodes, [this](auto& decode)
+  {
+    if (decode.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return false;
+
+    try
+    {
+      auto data = decode.data.get();
+      if (auto texture = decode.texture.lock())
+      {
+        texture->data = std::move(data);
+        _streaming_textures.emplace_back(texture);
+      }
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to load texture: {}", e.what());
+    }
+    return true;
+  });
+
+  // nothing is uploaded to new images, they're transitioned with upload of previews
+  std::erase_if(_streaming_textures, [](auto const& texture) { return texture.expired(); });
+  for (auto const& weak : _streaming_textures)
+  {
+    auto texture = weak.lock();
+    if (texture->image.image == VK_NULL_HANDLE)
+      create_texture_image(*texture, texture->data.width, texture->data.height);
+  }
+
+  // demoted textures drawn again are loaded from source
+  for (auto const& texture : _residency.take_promotions())
+  {
+    _texture_promotions.emplace_back(TextureDecode
+    {
+      .texture = texture,
+      .data    = std::async(std::launch::async, reload_image, texture->data.source),
+    });
+  }
+
+  // texture may be released while loading
+  std::erase_if(_texture_promotions, [this](auto& decode)
+  {
+    if (decode.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return false;
+
+    try
+    {
+      auto data = decode.data.get();
+      if (auto texture = decode.texture.lock())
+        _promoted_textures.emplace_back(std::move(texture), std::move(data));
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to reload texture: {}", e.what());
+    }
+    return true;
+  });
+}
+
+void GraphicsEngine::stream_textures(FrameResource& frame)
+{
+  std::erase_if(_streaming_textures, [](auto const& texture) { return texture.expired(); });
+  if (_streaming_textures.empty())
+    return;
+
+  //
+  // plan uploads, previews of new textures first, they are small and make textures usable.
+  // then rows of full resolution by order of requests under budget.
+  // texels are copied to stage buffer of this frame, its size is sum of both budgets.
+  //
+  struct Upload
+  {
+    Texture*               texture;
+    uint32_t               mip;
+    uint32_t               row;
+    uint32_t               row_count;
+    std::byte const*       texels;
+    uint32_t               size;
+  };
+  struct MipChain
+  {
+    Texture* texture;
+    uint32_t begin;
+    uint32_t end;
+  };
+  auto uploads     = std::pmr::vector<Upload>(&frame.arena);
+  auto mip_chains  = std::pmr::vector<MipChain>(&frame.arena);
+  auto new_images  = std::pmr::vector<ImageLayoutTransition>(&frame.arena);
+  auto textures    = std::pmr::vector<std::shared_ptr<Texture>>(&frame.arena);
+  for (auto const& weak : _streaming_textures)
+    textures.emplace_back(weak.lock());
+
+  auto preview_budget = Texture_Preview_Budget;
+  for (auto const& texture : textures)
+  {
+    if (texture->image.image == VK_NULL_HANDLE || texture->resident_mip != ~0u)
+      continue;
+
+    // small enough to upload at once, or preview
+    auto& data = texture->data;
+    auto  size = data.tail_mip == 0 ? data.texels.size() : data.preview.size();
+    if (FrameDataBuffer::aligned_size(size) > preview_budget)
+      break;
+    preview_budget -= FrameDataBuffer::aligned_size(size);
+    new_images.emplace_back(texture->image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    if (data.tail_mip == 0)
+    {
+      uploads.emplace_back(texture.get(), 0, 0, data.height, data.texels.data(), (uint32_t)size);
+      mip_chains.emplace_back(texture.get(), 1, texture->mip_count);
+      texture->uploaded_rows = data.height;
+      texture->resident_mip  = 0;
+    }
+    else
+    {
+      auto rows = std::max(1u, data.height >> data.tail_mip);
+      uploads.emplace_back(texture.get(), data.tail_mip, 0, rows, data.preview.data(), (uint32_t)size);
+      mip_chains.emplace_back(texture.get(), data.tail_mip + 1, texture->mip_count);
+      texture->resident_mip = data.tail_mip;
+    }
+  }
+
+  // rows are taken in whole aligned blocks of budget, so stage never overflows
+  auto budget = Texture_Upload_Budget;
+  for (auto const& texture : textures)
+  {
+    auto& data     = texture->data;
+    auto  row_size = data.width * 4;
+    auto  rows     = std::min(data.height - texture->uploaded_rows,
+                              budget / FrameDataBuffer::Alignment * FrameDataBuffer::Alignment / row_size);
+    if (texture->resident_mip == ~0u || rows == 0)
+      continue;
+
+    uploads.emplace_back(texture.get(), 0, texture->uploaded_rows, rows,
+                         data.texels.data() + texture->uploaded_rows * row_size, rows * row_size);
+    texture->uploaded_rows += rows;
+    budget -= FrameDataBuffer::aligned_size(rows * row_size);
+
+    // mips under tail were generated from preview
+    if (texture->uploaded_rows == data.height)
+      mip_chains.emplace_back(texture.get(), 1, data.tail_mip);
+  }
+
+  if (uploads.empty())
+    return;
+
+  auto cmd = frame.command_buffer;
+  transition_image_layouts(cmd, new_images, &frame.arena);
+
+  auto& stage = frame.texture_stage;
+  for (auto const& upload : uploads)
+  {
+    auto extent = upload.texture->image.extent;
+    VkBufferImageCopy region
+    {
+      .bufferOffset     = stage.push(std::span(upload.texels, upload.size)),
+      .imageSubresource =
+      {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .mipLevel   = upload.mip,
+        .layerCount = 1,
+      },
+      .imageOffset      = { 0, (int32_t)upload.row, 0 },
+      .imageExtent      = { std::max(1u, extent.width >> upload.mip), upload.row_count, 1 },
+    };
+    vkCmdCopyBufferToImage(cmd, stage.buffer.buffer, upload.texture->image.image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+  }
+
+  memory_barrier(cmd, VK_PIPELINE_STAGE_2_COPY_BIT,           VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  for (auto const& chain : mip_chains)
+    generate_mips(cmd, *chain.texture, chain.begin, chain.end);
+  memory_barrier(cmd, VK_PIPELINE_STAGE_2_COPY_BIT           | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_TRANSFER_WRITE_BIT         | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+
+  // full resolution is resident, texels are not needed anymore
+  std::erase_if(_streaming_textures, [](auto const& weak)
+  {
+    auto texture = weak.lock();
+    if (texture->uploaded_rows != texture->data.height)
+      return false;
+    texture->resident_mip = 0;
+    texture->data         = { .source = std::move(texture->data.source) };
+    return true;
+  });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//                               Residency
+////////////////////////////////////////////////////////////////////////////////
+
+void GraphicsEngine::update_residency(FrameResource& frame)
+{
+  auto textures = _residency.update(_vma_allocator);
+  if (textures.empty() && _promoted_textures.empty())
+    return;
+
+  // promotion and demotion are rare, they create images
+  auto allow_heap = AllowHeapScope();
+
+  // old images are written by uploads and mip generation of previous frames
+  memory_barrier(frame.command_buffer, VK_PIPELINE_STAGE_2_COPY_BIT   | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                       VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                       VK_PIPELINE_STAGE_2_COPY_BIT,    VK_ACCESS_2_TRANSFER_READ_BIT);
+  for (auto& [texture, data] : _promoted_textures)
+  {
+    try
+    {
+      promote_texture(frame, *texture, std::move(data));
+      _streaming_textures.emplace_back(texture);
+    }
+    catch (std::exception const& e)
+    {
+      log::error("failed to promote texture: {}", e.what());
+    }
+  }
+  _promoted_textures.clear();
+  for (auto const& texture : textures)
+    demote_texture(frame, *texture);
+  memory_barrier(frame.command_buffer, VK_PIPELINE_STAGE_2_COPY_BIT,            VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                       VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+}
+
+//
+// copy mips under top mip to a half size image, and rewrite bindless slot.
+// texture is cold, so slot isn't used by frames in flight.
+// texture with source is promoted when it's drawn again.
+//
+void GraphicsEngine::demote_texture(FrameResource& frame, Texture& texture)
+{
+  auto old_image = texture.image;
+  auto old_views = std::move(texture.mip_views);
+  auto extent    = old_image.extent;
+  create_texture_image(texture, std::max(1u, extent.width >> 1), std::max(1u, extent.height >> 1));
+
+  auto cmd     = frame.command_buffer;
+  auto regions = std::pmr::vector<VkImageCopy>(texture.mip_count, &frame.arena);
+  for (uint32_t i = 0; i < texture.mip_count; ++i)
+  {
+    regions[i] =
+    {
+      .srcSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i + 1, .layerCount = 1 },
+      .dstSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i,     .layerCount = 1 },
+      .extent         = { std::max(1u, extent.width >> (i + 1)), std::max(1u, extent.height >> (i + 1)), 1 },
+    };
+  }
+  transition_image_layout(cmd, texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  vkCmdCopyImage(cmd, old_image.image, VK_IMAGE_LAYOUT_GENERAL, texture.image.image, VK_IMAGE_LAYOUT_GENERAL,
+                 (uint32_t)regions.size(), regions.data());
+
+  // old image is read by this frame
+  for (auto view : old_views)
+    defer_destroy(view);
+  defer_destroy(old_image);
+  texture.demoted = !texture.data.source.empty();
+}
+
+//
+// create full size image at a new bindless slot, old slot may be sampled by frames in flight.
+// mips of demoted image are copied under top mips, so only top mips are streamed,
+// and mips between them are generated after full resolution uploaded.
+//
+void GraphicsEngine::promote_texture(FrameResource& frame, Texture& texture, ImageData&& data)
+{
+  auto extent    = texture.image.extent;
+  auto mip_count = (uint32_t)std::bit_width(std::max(data.width, data.height));
+  auto shift     = mip_count - texture.mip_count;
+  throw_if(mip_count <= texture.mip_count ||
+           std::max(1u, data.width >> shift) != extent.width || std::max(1u, data.height >> shift) != extent.height,
+           "source of texture {} is changed", data.source.path.string());
+  throw_if(_free_texture_indices.empty(), "too many textures, max is {}", Max_Texture_Count);
+
+  auto old_image = texture.image;
+  auto old_views = std::move(texture.mip_views);
+  auto old_index = texture.index;
+  auto old_mips  = texture.mip_count;
+  texture.index  = _free_texture_indices.back();
+  _free_texture_indices.pop_back();
+  create_texture_image(texture, data.width, data.height);
+
+  auto cmd     = frame.command_buffer;
+  auto regions = std::pmr::vector<VkImageCopy>(old_mips, &frame.arena);
+  for (uint32_t i = 0; i < old_mips; ++i)
+  {
+    regions[i] =
+    {
+      .srcSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i,         .layerCount = 1 },
+      .dstSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i + shift, .layerCount = 1 },
+      .extent         = { std::max(1u, extent.width >> i), std::max(1u, extent.height >> i), 1 },
+    };
+  }
+  transition_image_layout(cmd, texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  vkCmdCopyImage(cmd, old_image.image, VK_IMAGE_LAYOUT_GENERAL, texture.image.image, VK_IMAGE_LAYOUT_GENERAL,
+                 (uint32_t)regions.size(), regions.data());
+
+  // copied mips take place of preview, so streaming only uploads rows
+  texture.data          = std::move(data);
+  texture.data.tail_mip = shift;
+  texture.data.preview  = {};
+  texture.resident_mip  = shift;
+  texture.uploaded_rows = 0;
+  texture.demoted       = false;
+
+  // old image is read by this frame, and old slot by frames in flight
+  for (auto view : old_views)
+    defer_destroy(view);
+  defer_destroy(old_image);
+  defer_destroy([this, old_index] { _free_texture_indices.push_back(old_index); });
+}
+
+} }
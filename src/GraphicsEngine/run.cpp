@@ -2,14 +2,25 @@
 #include "ShaderStructs.hpp"
 #include "ErrorHandling.hpp"
 #include "constant.hpp"
+#include "HeapGuard.hpp"
+#include "AllocationTracker.hpp"
 
 #include <SDL3/SDL_events.h>
+#include <SDL3/SDL_timer.h>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
 namespace tk { namespace graphics_engine {
 
 void GraphicsEngine::keyboard_process(SDL_KeyboardEvent const& key)
 {
+  // event timestamp is SDL ticks, convert it to latency tracker's clock
+  _latency.on_input(LatencyTracker::now() - (SDL_GetTicksNS() - key.timestamp));
+
   switch (key.key)
   {
   case SDLK_1:
@@ -18,6 +29,18 @@ void GraphicsEngine::keyboard_process(SDL_KeyboardEvent const& key)
   case SDLK_2:
     _pipeline_index = 1;
     break;
+  case SDLK_U:
+    _compute_present = !_compute_present;
+    break;
+  case SDLK_T:
+    _tonemap_enabled = !_tonemap_enabled;
+    break;
+  case SDLK_C:
+    _meshlet_culling = !_meshlet_culling;
+    break;
+  case SDLK_O:
+    _occlusion_culling = !_occlusion_culling;
+    break;
   case SDLK_H:
     x -= 1;
     break;
@@ -43,22 +66,24 @@ VkClearColorValue Clear_Value;
 
 void GraphicsEngine::update()
 {
+  // reports of last frame are formatted to strings
+  _latency.end_frame();
+  allocation_tracker::end_frame(_submitted_serial);
+
+  auto allocation_scope = AllocationScope("update");
+
+  // finished loads create buffers and images, they're taken before hot path
+  poll_meshs();
+  poll_textures();
+
+  // steady frames never allocate, check it in heap guard build
+  auto no_heap = NoHeapScope();
+
   static auto start_time   = std::chrono::high_resolution_clock::now();
   auto        current_time = std::chrono::high_resolution_clock::now();
   float       time         = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
 
-  UniformBufferObject ubo;
-  ubo.model = glm::mat4(1.f);
-  ubo.view = glm::translate(glm::mat4(1.f), glm::vec3{ 0, 0, -5.f });
-  ubo.proj = glm::perspective(70.f, (float)_image.extent.width / _image.extent.height, 1000.f, 0.1f);
-  // ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  // ubo.view = glm::lookAt(glm::vec3(.0f, .0f, -1.f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, .0f));
-  // ubo.proj = glm::perspective(45.0f, _swapchain_image_extent.width / (float) _swapchain_image_extent.height, 0.1f, 10.0f);
-  // ubo.view  = glm::lookAt(glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
-  // ubo.proj  = glm::ortho(-1.f, 1.f, -1.f, 1.f, -1.f, 100.f);
-
-  // TODO: use vma to presently mapped, and vma's copy memory function
-  // vmaCopyMemoryToAllocation(_vma_allocator, &ubo, _uniform_buffer_allocations[_current_frame], 0, sizeof(ubo));
+  // camera and transforms are written to frame data buffer when recording, see draw_geometry()
 
   // clear value
   uint32_t circle = time / 3;
@@ -72,6 +97,8 @@ void GraphicsEngine::update()
   else
     b = val;
   Clear_Value = { { r, g, b, 1.f } };
+
+  _latency.on_update();
 }
 
 //
@@ -80,10 +107,13 @@ void GraphicsEngine::update()
 //
 void GraphicsEngine::draw()
 {
+  auto no_heap          = NoHeapScope();
+  auto allocation_scope = AllocationScope("draw");
+
   //
   // get current frame resource
   //
-  auto frame = get_current_frame();
+  auto& frame = get_current_frame();
 
   //
   // wait commands completely submitted to GPU,
@@ -94,8 +124,17 @@ void GraphicsEngine::draw()
   // so you can know whether finished for commands handled by GPU.
   throw_if(vkWaitForFences(_device, 1, &frame.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS,
            "failed to wait fence");
-  throw_if(vkResetFences(_device, 1, &frame.fence) != VK_SUCCESS,
-           "failed to reset fence");
+  frame.arena.reset();
+  frame.frame_data.reset();
+  frame.texture_stage.reset();
+  frame.descriptors.reset();
+
+  // resources retired by finished frames are not used by GPU anymore
+  auto completed_serial = collect_garbage();
+  if (!_swapchain_maintenance_supported)
+    on_present_finished(frame.present_id);
+  if (_defrag_serial != 0 && _defrag_serial <= completed_serial)
+    end_defragment_pass();
 
   //
   // acquire an available image which GPU not used currently,
@@ -111,9 +150,19 @@ void GraphicsEngine::draw()
   else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR)
     throw_if(true, "failed to acquire swapechain image");
 
-  // get draw extent
-  _draw_extent.width  = std::min(_swapchain_image_extent.width, _image.extent.width);
-  _draw_extent.height = std::min(_swapchain_image_extent.height, _image.extent.height);
+  // image is released by presentation engine when acquire signaled, so its last present is finished
+  if (!_swapchain_maintenance_supported)
+    frame.present_id = _swapchain_present_ids[image_index];
+
+  // only reset fence when we will submit work,
+  // otherwise fence never be signaled after swapchain recreated.
+  throw_if(vkResetFences(_device, 1, &frame.fence) != VK_SUCCESS,
+           "failed to reset fence");
+
+  _latency.on_record();
+
+  update_draw_extent(frame);
+  update_camera();
 
   //
   // now we know current frame resource is available,
@@ -129,6 +178,14 @@ void GraphicsEngine::draw()
   };
   vkBeginCommandBuffer(frame.command_buffer, &beg_info);
 
+  // measure GPU time of whole frame
+  auto query_index = _current_frame * 2;
+  if (_query_pool != VK_NULL_HANDLE)
+  {
+    vkCmdResetQueryPool(frame.command_buffer, _query_pool, query_index, 2);
+    vkCmdWriteTimestamp2(frame.command_buffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, _query_pool, query_index);
+  }
+
   // HACK: make frame.command_buffer and _swapchain_images[image_index] to frame resource function
   // only need like as follow:
   //   render_begin();  // get current frame, available command buffer and image.
@@ -143,15 +200,32 @@ void GraphicsEngine::draw()
 
   transition_image_layout(frame.command_buffer, _image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
   transition_image_layout(frame.command_buffer, _depth_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  update_residency(frame);
+  defragment_geometry(frame);
+  stream_textures(frame);
+  update_hzb_set(frame);
+  cull_meshlets(frame);
   draw_geometry(frame.command_buffer);
+  build_hzb(frame);
 
-  // copy image to swapchain image
-  transition_image_layout(frame.command_buffer, _image.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-  transition_image_layout(frame.command_buffer, _swapchain_images[image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  copy_image(frame.command_buffer, _image.image, _swapchain_images[image_index], _draw_extent, _swapchain_image_extent);
+  if (_compute_present && _present_pipeline != VK_NULL_HANDLE)
+    draw_present(frame.command_buffer, image_index);
+  else
+  {
+    // copy image to swapchain image
+    transition_image_layout(frame.command_buffer, _image.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    transition_image_layout(frame.command_buffer, _swapchain_images[image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    copy_image(frame.command_buffer, _image.image, _swapchain_images[image_index], _draw_extent, _swapchain_image_extent);
 
-  // transition image layout to presentable
-  transition_image_layout(frame.command_buffer, _swapchain_images[image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    // transition image layout to presentable
+    transition_image_layout(frame.command_buffer, _swapchain_images[image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  }
+
+  if (_query_pool != VK_NULL_HANDLE)
+  {
+    vkCmdWriteTimestamp2(frame.command_buffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, _query_pool, query_index + 1);
+    frame.has_timestamps = true;
+  }
 
   throw_if(vkEndCommandBuffer(frame.command_buffer) != VK_SUCCESS,
            "failed to end command buffer");
@@ -171,9 +245,21 @@ void GraphicsEngine::draw()
     .value     = 1,
     .stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
   };
-  auto signal_sem_submit_info      = wait_sem_submit_info;
-  signal_sem_submit_info.semaphore = frame.render_finished_sem;
-  signal_sem_submit_info.stageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
+  // timeline is signaled after all commands finished, resources released before are destroyed then
+  std::array<VkSemaphoreSubmitInfo, 2> signal_sem_submit_infos
+  {{
+    {
+      .sType     = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = frame.render_finished_sem,
+      .stageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT,
+    },
+    {
+      .sType     = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+      .semaphore = _frame_timeline,
+      .value     = _submitted_serial + 1,
+      .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+    },
+  }};
 
   VkSubmitInfo2 submit_info
   {
@@ -182,18 +268,49 @@ void GraphicsEngine::draw()
     .pWaitSemaphoreInfos      = &wait_sem_submit_info,
     .commandBufferInfoCount   = 1,
     .pCommandBufferInfos      = &cmd_submit_info,
-    .signalSemaphoreInfoCount = 1,
-    .pSignalSemaphoreInfos    = &signal_sem_submit_info,
+    .signalSemaphoreInfoCount = (uint32_t)signal_sem_submit_infos.size(),
+    .pSignalSemaphoreInfos    = signal_sem_submit_infos.data(),
   };
   throw_if(vkQueueSubmit2(_graphics_queue, 1, &submit_info, frame.fence),
            "failed to submit to queue");
+  ++_submitted_serial;
+  _latency.on_submit();
 
   //
   // present to screen
   //
+  // present id is used to match actual present time of VK_GOOGLE_display_timing
+  VkPresentTimeGOOGLE present_time
+  {
+    .presentID = ++_present_id,
+  };
+  VkPresentTimesInfoGOOGLE present_times_info
+  {
+    .sType          = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+    .swapchainCount = 1,
+    .pTimes         = &present_time,
+  };
+  // present fence is reused after last present of this frame is finished, which is in general
+  VkSwapchainPresentFenceInfoEXT present_fence_info
+  {
+    .sType          = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+    .pNext          = _display_timing_supported ? &present_times_info : nullptr,
+    .swapchainCount = 1,
+    .pFences        = &frame.present_fence,
+  };
+  if (_swapchain_maintenance_supported)
+  {
+    throw_if(vkWaitForFences(_device, 1, &frame.present_fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS ||
+             vkResetFences(_device, 1, &frame.present_fence)                         != VK_SUCCESS,
+             "failed to wait present fence");
+    on_present_finished(frame.present_id);
+    frame.present_id = _present_id;
+  }
   VkPresentInfoKHR presentation_info
   {
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+    .pNext = _swapchain_maintenance_supported ? (void*)&present_fence_info :
+             _display_timing_supported        ? (void*)&present_times_info : nullptr,
     .waitSemaphoreCount = 1,
     .pWaitSemaphores    = &frame.render_finished_sem,
     .swapchainCount     = 1,
@@ -201,15 +318,83 @@ void GraphicsEngine::draw()
     .pImageIndices      = &image_index,
   };
   res = vkQueuePresentKHR(_present_queue, &presentation_info); 
+  _swapchain_present_ids[image_index] = _present_id;
+  // out of date present is never displayed, so it has no latency sample
+  if (res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR)
+    _latency.on_present(_present_id, _display_timing_supported);
   if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR)
     resize_swapchain(); 
   else if (res != VK_SUCCESS)
     throw_if(true, "failed to present swapchain image");
 
+  poll_present_timing();
+
   // update frame index
   _current_frame = ++_current_frame % Max_Frame_Number;
 }
 
+void GraphicsEngine::update_draw_extent(FrameResource const& frame)
+{
+  //
+  // feed GPU time of last finished frame in this frame resource to resolution controller
+  //
+  if (frame.has_timestamps)
+  {
+    std::array<uint64_t, 2> timestamps;
+    if (vkGetQueryPoolResults(_device, _query_pool, _current_frame * 2, 2, sizeof(timestamps), timestamps.data(),
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+    {
+      auto ticks = (timestamps[1] - timestamps[0]) & _timestamp_mask;
+      _resolution.update(ticks * _timestamp_period / 1'000'000.f);
+    }
+  }
+
+  //
+  // draw extent not bigger than offscreen image, scaled by dynamic resolution,
+  // copy_image() will upscale it to swapchain image.
+  //
+  auto scale          = _resolution.scale();
+  _draw_extent.width  = std::max(1u, (uint32_t)(std::min(_swapchain_image_extent.width,  _image.extent.width)  * scale));
+  _draw_extent.height = std::max(1u, (uint32_t)(std::min(_swapchain_image_extent.height, _image.extent.height) * scale));
+}
+
+void GraphicsEngine::update_camera()
+{
+  // auto view = glm::translate(glm::mat4(1.f), glm::vec3{ x, y, z });
+  _view = glm::translate(glm::mat4(1.f), glm::vec3{ 0, 0, -5.f });
+  _proj = glm::perspective(70.f, (float)_draw_extent.width / _draw_extent.height, 10000.f, 0.1f);
+  _proj[1][1] *= -1;
+}
+
+//
+// a mesh space unit is max scale of world matrix in world space.
+// distance is to nearest point of bounds sphere, so lod isn't coarser than any part of mesh needs.
+//
+auto GraphicsEngine::get_pixels_per_unit(MeshAsset const& mesh, glm::mat4 const& world) const -> float
+{
+  auto axis   = [&](int i) { return glm::dot(glm::vec3(world[i]), glm::vec3(world[i])); };
+  auto scale  = std::sqrt(std::max({ axis(0), axis(1), axis(2) }));
+  auto center = glm::vec3(_view * world * glm::vec4((mesh.bounds.min + mesh.bounds.max) * .5f, 1.f));
+  auto radius = glm::length(mesh.bounds.max - mesh.bounds.min) * .5f * scale;
+  return scale * _draw_extent.height * .5f * std::abs(_proj[1][1]) / std::max(glm::length(center) - radius, .1f);
+}
+
+void GraphicsEngine::poll_present_timing()
+{
+  if (!_display_timing_supported)
+    return;
+
+  // results of presents which are already displayed, 
+  // return VK_INCOMPLETE when more timings available than array size.
+  std::array<VkPastPresentationTimingGOOGLE, 8> timings;
+  uint32_t count = timings.size();
+  auto res = _vkGetPastPresentationTimingGOOGLE(_device, _swapchain, &count, timings.data());
+  if (res != VK_SUCCESS && res != VK_INCOMPLETE)
+    return;
+  for (uint32_t i = 0; i < count; ++i)
+    _latency.on_display(timings[i].presentID, timings[i].actualPresentTime);
+}
+
 void GraphicsEngine::draw_background(VkCommandBuffer cmd)
 {
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _compute_pipeline[_pipeline_index]);
@@ -223,7 +408,8 @@ void GraphicsEngine::draw_background(VkCommandBuffer cmd)
     vkCmdPushConstants(cmd, _compute_pipeline_layout[_pipeline_index], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
   }
 
-  vkCmdDispatch(cmd, std::ceil(_draw_extent.width / 16.f), std::ceil(_draw_extent.height / 16.f), 1);
+  vkCmdDispatch(cmd, (_draw_extent.width  + _background_group_size.width  - 1) / _background_group_size.width,
+                     (_draw_extent.height + _background_group_size.height - 1) / _background_group_size.height, 1);
   // auto clear_range = get_image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
   // vkCmdClearColorImage(cmd, _image.image, VK_IMAGE_LAYOUT_GENERAL, &Clear_Value, 1, &clear_range);
 }
@@ -277,25 +463,75 @@ void GraphicsEngine::draw_geometry(VkCommandBuffer cmd)
   };
   vkCmdSetScissor(cmd, 0, 1, &scissor);
 
+  //
+  // camera and transforms of this frame, quad is already in clip space,
+  // meshs are at origin.
+  //
+  auto& frame         = get_current_frame();
+  auto  identity      = glm::mat4(1.f);
+  auto  screen_camera = frame.frame_data.push(CameraData{ identity, identity, identity, {} });
+  auto  camera        = frame.frame_data.push(CameraData
+  {
+    .view      = _view,
+    .proj      = _proj,
+    .view_proj = _proj * _view,
+    .position  = glm::inverse(_view) * glm::vec4(0.f, 0.f, 0.f, 1.f),
+  });
+  auto  origin        = frame.frame_data.push(ObjectData{ identity });
+
   // draw mesh
+  constexpr VkShaderStageFlags Push_Stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline);
+  _pipelines.set_dynamic_state(cmd, _mesh_pipeline_key);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _mesh_pipeline_layout, 0, 1, &_texture_set, 0, nullptr);
   GeometryPushConstant push_constant;
-  push_constant.world_matrix = glm::mat4(1.f);
-  push_constant.address      = _mesh_buffer.address;
-  vkCmdPushConstants(cmd, _mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constant), &push_constant);
+  push_constant.camera        = screen_camera;
+  push_constant.objects       = origin;
+  push_constant.address       = _mesh_buffer.address;
+  push_constant.texture_index = _default_texture->index;
+  vkCmdPushConstants(cmd, _mesh_pipeline_layout, Push_Stages, 0, sizeof(push_constant), &push_constant);
   vkCmdBindIndexBuffer(cmd, _mesh_buffer.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
   vkCmdDrawIndexed(cmd, 6, 1, 0, 0, 0);
 
-  // draw monkey
-  // auto view = glm::translate(glm::mat4(1.f), glm::vec3{ x, y, z });
-  auto view = glm::translate(glm::mat4(1.f), glm::vec3{ 0, 0, -5.f });
-  auto proj = glm::perspective(70.f, (float)_draw_extent.width / _draw_extent.height, 10000.f, 0.1f);
-  proj[1][1] *= -1;
-  push_constant.world_matrix = proj * view;
-  push_constant.address = _meshs[0]->mesh_buffer.address;
-  vkCmdPushConstants(cmd, _mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constant), &push_constant);
-  vkCmdBindIndexBuffer(cmd, _meshs[0]->mesh_buffer.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-  vkCmdDrawIndexed(cmd, _meshs[0]->surfaces[0].count, 1, _meshs[0]->surfaces[0].start_index, 0, 0);
+  // draw meshs, draw commands of culled meshs are in same order as cull pass
+  push_constant.camera = camera;
+  uint32_t draw_index  = 0;
+  for (auto const& handle : _meshs)
+  {
+    auto& mesh = *handle;
+    _residency.touch(mesh);
+    push_constant.address = mesh.mesh_buffer.address;
+    auto set_texture = [&](GeometrySurface const& surface)
+    {
+      auto texture = surface.image < mesh.textures.size() ? mesh.textures[surface.image].get() : nullptr;
+      if (texture)
+        _residency.touch(*texture);
+      std::tie(push_constant.texture_index, push_constant.min_lod) = get_texture_binding(texture);
+      vkCmdPushConstants(cmd, _mesh_pipeline_layout, Push_Stages, 0, sizeof(push_constant), &push_constant);
+    };
+
+    // visible meshlets of selected lods are compacted by cull pass, one command per surface
+    if (frame.culled && mesh.mesh_buffer.meshlet_address != 0)
+    {
+      vkCmdBindIndexBuffer(cmd, frame.cull_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+      for (auto const& surface : mesh.surfaces)
+      {
+        set_texture(surface);
+        vkCmdDrawIndexedIndirect(cmd, frame.cull_draw.buffer, draw_index++ * sizeof(CullDrawCommand), 1, sizeof(CullDrawCommand));
+      }
+    }
+    else
+    {
+      vkCmdBindIndexBuffer(cmd, mesh.mesh_buffer.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+      auto pixels_per_unit = get_pixels_per_unit(mesh, identity);
+      for (auto const& surface : mesh.surfaces)
+      {
+        set_texture(surface);
+        auto& lod = surface.select_lod(pixels_per_unit, Lod_Error_Pixels);
+        vkCmdDrawIndexed(cmd, lod.count, 1, lod.start_index, 0, 0);
+      }
+    }
+  }
 
   // draw triangle
   // vkCmdEndRendering(cmd);
@@ -309,4 +545,306 @@ void GraphicsEngine::draw_geometry(VkCommandBuffer cmd)
   vkCmdEndRendering(cmd);
 }
     
+void GraphicsEngine::draw_present(VkCommandBuffer cmd, uint32_t image_index)
+{
+  auto& frame       = get_current_frame();
+  auto  swapchain   = _swapchain_images[image_index];
+  auto  target      = _swapchain_storage ? swapchain                           : _present_image.image;
+  auto  target_view = _swapchain_storage ? _swapchain_image_views[image_index] : _present_image.view;
+
+  // swapchain image changes every frame, so set is allocated from frame's pools
+  frame.present_set = frame.descriptors.allocate(_present_set_layout);
+  VkDescriptorImageInfo image_infos[]
+  {
+    {
+      .imageView   = _image.view,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+    {
+      .imageView   = target_view,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+  };
+  VkWriteDescriptorSet writes[]
+  {
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = frame.present_set,
+      .dstBinding      = 0,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .pImageInfo      = &image_infos[0],
+    },
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = frame.present_set,
+      .dstBinding      = 1,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .pImageInfo      = &image_infos[1],
+    },
+  };
+  vkUpdateDescriptorSets(_device, 2, writes, 0, nullptr);
+
+  ImageLayoutTransition transitions[]
+  {
+    { _image.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL },
+    { target,       VK_IMAGE_LAYOUT_UNDEFINED,                VK_IMAGE_LAYOUT_GENERAL },
+  };
+  transition_image_layouts(cmd, transitions, &frame.arena);
+
+  //
+  // output transform converts HDR image to display, gamma only for UNORM format,
+  // SRGB format is encoded by hardware.
+  //
+  uint32_t flags = 0;
+  if (_tonemap_enabled)
+  {
+    flags = Present_Tonemap | Present_Dither;
+    if (_swapchain_format == VK_FORMAT_B8G8R8A8_UNORM ||
+        _swapchain_format == VK_FORMAT_R8G8B8A8_UNORM)
+      flags |= Present_Gamma;
+  }
+
+  // only use upscaler when draw extent is smaller than swapchain extent
+  auto upscale = _draw_extent.width  != _swapchain_image_extent.width ||
+                 _draw_extent.height != _swapchain_image_extent.height;
+
+  PresentPushConstant pc
+  {
+    .input_size  = glm::ivec2(_draw_extent.width, _draw_extent.height),
+    .output_size = glm::ivec2(_swapchain_image_extent.width, _swapchain_image_extent.height),
+    .sharpness   = _sharpness,
+    .flags       = flags,
+    .frame       = _frame_count++,
+  };
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, upscale ? _upscale_pipeline : _present_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _present_pipeline_layout, 0, 1, &frame.present_set, 0, nullptr);
+  vkCmdPushConstants(cmd, _present_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+  vkCmdDispatch(cmd, std::ceil(_swapchain_image_extent.width / 8.f), std::ceil(_swapchain_image_extent.height / 8.f), 1);
+
+  if (_swapchain_storage)
+  {
+    transition_image_layout(cmd, swapchain, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    return;
+  }
+
+  // copy intermediate image to swapchain image, same size so no filtering
+  transition_image_layout(cmd, _present_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  transition_image_layout(cmd, swapchain, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  copy_image(cmd, _present_image.image, swapchain, _swapchain_image_extent, _swapchain_image_extent);
+  transition_image_layout(cmd, swapchain, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+    
+void GraphicsEngine::update_hzb_set(FrameResource& frame)
+{
+  frame.hzb_set = frame.descriptors.allocate(_hzb_set_layout);
+
+  // unused mips of the array are filled by last mip, so all descriptors are valid
+  VkDescriptorImageInfo depth_info
+  {
+    .sampler     = _hzb_sampler,
+    .imageView   = _depth_image.view,
+    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+  };
+  std::array<VkDescriptorImageInfo, Max_Hzb_Mip_Count> mip_infos;
+  for (uint32_t i = 0; i < mip_infos.size(); ++i)
+    mip_infos[i] =
+    {
+      .imageView   = _hzb_mip_views[std::min(i, _hzb_mip_count - 1)],
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+  VkDescriptorImageInfo hzb_info
+  {
+    .sampler     = _hzb_sampler,
+    .imageView   = _hzb.view,
+    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+  };
+
+  std::array<VkWriteDescriptorSet, 3> writes
+  {{
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = frame.hzb_set,
+      .dstBinding      = 0,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo      = &depth_info,
+    },
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = frame.hzb_set,
+      .dstBinding      = 1,
+      .descriptorCount = (uint32_t)mip_infos.size(),
+      .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .pImageInfo      = mip_infos.data(),
+    },
+    {
+      .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet          = frame.hzb_set,
+      .dstBinding      = 2,
+      .descriptorCount = 1,
+      .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo      = &hzb_info,
+    },
+  }};
+  vkUpdateDescriptorSets(_device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void GraphicsEngine::cull_meshlets(FrameResource& frame)
+{
+  // meshs without meshlets are drawn unculled
+  auto draw_count = get_cull_counts().second;
+  frame.culled = _meshlet_culling && draw_count != 0;
+  if (!frame.culled)
+    return;
+
+  auto cmd = frame.command_buffer;
+
+  //
+  // frustum planes and camera position in mesh space, meshs are at origin.
+  // clip space is x, y in [-w, w] and z in [0, w].
+  //
+  auto matrix = _proj * _view;
+  auto row    = [&](int i) { return glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]); };
+  std::array<glm::vec4, 6> planes
+  {
+    row(3) + row(0), row(3) - row(0),
+    row(3) + row(1), row(3) - row(1),
+    row(2),          row(3) - row(2),
+  };
+
+  CullData data = {};
+  for (uint32_t i = 0; i < planes.size(); ++i)
+    data.frustum_planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+  data.camera_position = glm::inverse(_view) * glm::vec4(0.f, 0.f, 0.f, 1.f);
+  data.flags           = Cull_Frustum | Cull_Cone;
+  if (_occlusion_culling && _hzb_valid)
+  {
+    data.flags           |= Cull_Occlusion;
+    data.hzb_matrix       = _hzb_view_proj;
+    data.hzb_size         = glm::ivec2(_hzb_extent.width, _hzb_extent.height);
+    data.hzb_level_count  = _hzb_level_count;
+  }
+
+  // indices of each surface are compacted in range of its full detail indices,
+  // offset by ranges of previous meshs
+  auto     draws        = std::pmr::vector<CullDrawCommand>(&frame.arena);
+  uint32_t index_offset = 0;
+  draws.reserve(draw_count);
+  for (auto const& mesh : _meshs)
+  {
+    if (mesh->mesh_buffer.meshlet_address == 0)
+      continue;
+    for (auto const& surface : mesh->surfaces)
+      draws.push_back({ .command =
+      {
+        .indexCount    = 0,
+        .instanceCount = 1,
+        .firstIndex    = index_offset + surface.start_index,
+      }});
+    index_offset += get_cull_index_count(*mesh);
+  }
+  // update is limited to 65536 bytes each
+  static constexpr uint32_t Max_Update_Count = 65536 / sizeof(CullDrawCommand);
+  for (uint32_t i = 0; i < draws.size(); i += Max_Update_Count)
+  {
+    auto count = std::min<size_t>(Max_Update_Count, draws.size() - i);
+    vkCmdUpdateBuffer(cmd, frame.cull_draw.buffer, i * sizeof(CullDrawCommand), count * sizeof(CullDrawCommand), draws.data() + i);
+  }
+
+  // also wait hzb built by last frame
+  memory_barrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT         | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_TRANSFER_WRITE_BIT           | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_READ_BIT      | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                      VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline_layout, 0, 1, &frame.hzb_set, 0, nullptr);
+
+  CullPushConstant push_constant
+  {
+    .out_indices  = get_buffer_address(frame.cull_indices.buffer),
+    .cull_data    = frame.frame_data.push(data),
+  };
+
+  // one workgroup per meshlet of selected lod, split by max workgroup count
+  static constexpr uint32_t Max_Dispatch_Count = 65535;
+  auto draw_address = get_buffer_address(frame.cull_draw.buffer);
+  for (auto const& handle : _meshs)
+  {
+    auto& mesh = *handle;
+    if (mesh.mesh_buffer.meshlet_address == 0)
+      continue;
+    push_constant.meshlets = mesh.mesh_buffer.meshlet_address;
+    push_constant.indices  = mesh.mesh_buffer.index_address;
+    auto pixels_per_unit   = get_pixels_per_unit(mesh, glm::mat4(1.f));
+    for (auto const& surface : mesh.surfaces)
+    {
+      auto& lod = surface.select_lod(pixels_per_unit, Lod_Error_Pixels);
+      push_constant.draw_command = draw_address;
+      draw_address              += sizeof(CullDrawCommand);
+      for (uint32_t offset = 0; offset < lod.meshlet_count; offset += Max_Dispatch_Count)
+      {
+        push_constant.meshlet_offset = lod.meshlet_offset + offset;
+        push_constant.meshlet_count  = std::min(Max_Dispatch_Count, lod.meshlet_count - offset);
+        vkCmdPushConstants(cmd, _cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constant), &push_constant);
+        vkCmdDispatch(cmd, push_constant.meshlet_count, 1, 1);
+      }
+    }
+  }
+
+  memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                      VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT    | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+                      VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT    | VK_ACCESS_2_INDEX_READ_BIT);
+}
+
+void GraphicsEngine::build_hzb(FrameResource& frame)
+{
+  if (!_meshlet_culling || !_occlusion_culling)
+  {
+    _hzb_valid = false;
+    return;
+  }
+
+  auto cmd = frame.command_buffer;
+
+  // whole hzb is rebuilt, old content can be discarded
+  std::array<ImageLayoutTransition, 2> transitions
+  {{
+    { _depth_image.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL },
+    { _hzb.image,         VK_IMAGE_LAYOUT_UNDEFINED,                VK_IMAGE_LAYOUT_GENERAL                 },
+  }};
+  transition_image_layouts(cmd, transitions, &frame.arena);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _hzb_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _hzb_pipeline_layout, 0, 1, &frame.hzb_set, 0, nullptr);
+
+  // reduce until 1x1, each level reads previous one
+  HzbPushConstant push_constant
+  {
+    .src_size = glm::ivec2(_draw_extent.width, _draw_extent.height),
+  };
+  uint32_t level_count = 0;
+  while (level_count < _hzb_mip_count)
+  {
+    push_constant.dst_size = glm::max(glm::ivec2(1), (push_constant.src_size + 1) / 2);
+    push_constant.level    = level_count++;
+    vkCmdPushConstants(cmd, _hzb_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constant), &push_constant);
+    vkCmdDispatch(cmd, std::ceil(push_constant.dst_size.x / 8.f), std::ceil(push_constant.dst_size.y / 8.f), 1);
+    memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    if (push_constant.dst_size == glm::ivec2(1))
+      break;
+    push_constant.src_size = push_constant.dst_size;
+  }
+
+  _hzb_level_count = level_count;
+  _hzb_extent      = _draw_extent;
+  _hzb_view_proj   = _proj * _view;
+  _hzb_valid       = true;
+}
+
 } }
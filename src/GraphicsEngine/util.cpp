@@ -1,6 +1,13 @@
 #include "GraphicsEngine.hpp"
 #include "ErrorHandling.hpp"
+#include "Log.hpp"
 #include "Buffer.hpp"
+#include "constant.hpp"
+#include "AllocationTracker.hpp"
+#include "HeapGuard.hpp"
+
+#include <memory_resource>
+#include <utility>
 
 namespace tk { namespace graphics_engine {
 
@@ -114,9 +121,10 @@ void GraphicsEngine::create_buffer(VkBuffer& buffer, VmaAllocation& allocation,
   return;
 }
 
-Buffer GraphicsEngine::create_buffer(uint32_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flag)
+Buffer GraphicsEngine::create_buffer(uint32_t size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flag, VmaPool pool)
 {
   Buffer buffer;
+  buffer.size = size;
 
   VkBufferCreateInfo buf_info
   {
@@ -128,58 +136,124 @@ Buffer GraphicsEngine::create_buffer(uint32_t size, VkBufferUsageFlags usage, Vm
   {
     .flags = flag,
     .usage = VMA_MEMORY_USAGE_AUTO,
+    .pool  = pool,
   };
-  throw_if(vmaCreateBuffer(_vma_allocator, &buf_info, &alloc_info, &buffer.buffer, &buffer.allocation, nullptr) != VK_SUCCESS,
-           "failed to create buffer");
+  auto res = vmaCreateBuffer(_vma_allocator, &buf_info, &alloc_info, &buffer.buffer, &buffer.allocation, nullptr);
+  if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY)
+  {
+    reclaim_memory();
+    res = vmaCreateBuffer(_vma_allocator, &buf_info, &alloc_info, &buffer.buffer, &buffer.allocation, nullptr);
+  }
+  throw_if(res != VK_SUCCESS, "failed to create buffer");
 
   return buffer;
 }
 
-auto GraphicsEngine::create_mesh_buffer(std::span<Vertex> vertices, std::span<uint32_t> indices) -> MeshBuffer
+//
+// memory released before last submit is freed after GPU idle.
+// resources released after it may be used by recording commands, so they are kept.
+// retained meshs are only used by submitted frames, so they are destroyed at once.
+//
+void GraphicsEngine::reclaim_memory()
 {
-  // create mesh buffer 
-  uint32_t vertices_size = vertices.size() * sizeof(Vertex);
-  uint32_t indices_size  = indices.size() * sizeof(uint32_t);
-
-  MeshBuffer mesh_buffer;
-  mesh_buffer.vertices = create_buffer(vertices_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT         |
-                                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT           | 
-                                                      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  auto allow_heap = AllowHeapScope();
+  vkDeviceWaitIdle(_device);
+  collect_garbage();
+
+  // release retained meshs to an empty queue and flush it, pending ones are kept
+  auto pending = std::exchange(_deletion_queue, {});
+  auto count   = _residency.release_retained();
+  _deletion_queue.flush(_device, _vma_allocator);
+  _deletion_queue = std::move(pending);
+  log::info("out of device memory, released {} retained meshs", count);
+}
 
+auto GraphicsEngine::get_buffer_address(VkBuffer buffer) const -> VkDeviceAddress
+{
   VkBufferDeviceAddressInfo info
   {
     .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-    .buffer = mesh_buffer.vertices.buffer,
+    .buffer = buffer,
   };
-  mesh_buffer.address = vkGetBufferDeviceAddress(_device, &info);
+  return vkGetBufferDeviceAddress(_device, &info);
+}
 
-  mesh_buffer.indices = create_buffer(indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | 
-                                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+auto GraphicsEngine::create_mesh_buffer(std::span<Vertex> vertices, std::span<uint32_t> indices) -> MeshBuffer
+{
+  MeshData mesh{ vertices, indices };
+  return create_mesh_buffers({ &mesh, 1 }).front();
+}
 
-  // create stage buffer
-  auto stage = create_buffer(vertices_size + indices_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-  throw_if(vmaCopyMemoryToAllocation(_vma_allocator, vertices.data(), stage.allocation, 0, vertices_size) != VK_SUCCESS,
-           "failed to copy vertices data to stage buffer");
-  throw_if(vmaCopyMemoryToAllocation(_vma_allocator, indices.data(), stage.allocation, vertices_size, indices_size) != VK_SUCCESS,
-           "failed to copy indices data to stage buffer");
+auto GraphicsEngine::create_mesh_buffers(std::span<MeshData const> meshs) -> std::vector<MeshBuffer>
+{
+  // single mesh also comes here, both are tagged as one
+  auto allocation_scope = AllocationScope("create_mesh_buffer");
+
+  //
+  // create mesh buffers and get total size of stage buffer,
+  // stage layout is vertices, indices then meshlets of each mesh.
+  // indices and meshlets are also read by cull pass.
+  //
+  std::vector<MeshBuffer> mesh_buffers;
+  mesh_buffers.reserve(meshs.size());
+  uint32_t stage_size = 0;
+  for (auto const& mesh : meshs)
+  {
+    uint32_t vertices_size = mesh.vertices.size_bytes();
+    uint32_t indices_size  = mesh.indices.size_bytes();
+    uint32_t meshlets_size = mesh.meshlets.size_bytes();
 
-  // transform data to mesh buffer
+    // geometry is allocated from its own pool, which is defragmented incrementally
+    MeshBuffer mesh_buffer;
+    mesh_buffer.vertices = create_buffer(vertices_size, Geometry_Buffer_Usage, 0, _geometry_pool);
+    mesh_buffer.address  = get_buffer_address(mesh_buffer.vertices.buffer);
+
+    mesh_buffer.indices       = create_buffer(indices_size, Geometry_Buffer_Usage, 0, _geometry_pool);
+    mesh_buffer.index_address = get_buffer_address(mesh_buffer.indices.buffer);
+
+    if (meshlets_size > 0)
+    {
+      mesh_buffer.meshlets        = create_buffer(meshlets_size, Geometry_Buffer_Usage, 0, _geometry_pool);
+      mesh_buffer.meshlet_address = get_buffer_address(mesh_buffer.meshlets.buffer);
+    }
+
+    mesh_buffers.emplace_back(mesh_buffer);
+    stage_size += vertices_size + indices_size + meshlets_size;
+  }
+
+  // create stage buffer, copy all meshs to it
+  auto stage = create_buffer(stage_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+  // transform data to mesh buffers
   auto cmd = begin_single_time_commands();
 
-  VkBufferCopy copy
+  VkDeviceSize offset = 0;
+  auto copy = [&](void const* data, uint32_t size, VkBuffer dst)
   {
-    .size = vertices_size,
+    if (size == 0)
+      return;
+    throw_if(vmaCopyMemoryToAllocation(_vma_allocator, data, stage.allocation, offset, size) != VK_SUCCESS,
+             "failed to copy mesh data to stage buffer");
+    VkBufferCopy region
+    {
+      .srcOffset = offset,
+      .size      = size,
+    };
+    vkCmdCopyBuffer(cmd, stage.buffer, dst, 1, &region);
+    offset += size;
   };
-  vkCmdCopyBuffer(cmd, stage.buffer, mesh_buffer.vertices.buffer, 1, &copy);
-  copy.size = indices_size;
-  copy.srcOffset = vertices_size;
-  vkCmdCopyBuffer(cmd, stage.buffer, mesh_buffer.indices.buffer, 1, &copy);
+  for (uint32_t i = 0; i < meshs.size(); ++i)
+  {
+    copy(meshs[i].vertices.data(), meshs[i].vertices.size_bytes(), mesh_buffers[i].vertices.buffer);
+    copy(meshs[i].indices.data(),  meshs[i].indices.size_bytes(),  mesh_buffers[i].indices.buffer);
+    copy(meshs[i].meshlets.data(), meshs[i].meshlets.size_bytes(), mesh_buffers[i].meshlets.buffer);
+  }
 
   end_single_time_commands(cmd);
 
   stage.destroy(_vma_allocator);
 
-  return mesh_buffer;
+  return mesh_buffers;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -188,11 +262,47 @@ auto GraphicsEngine::create_mesh_buffer(std::span<Vertex> vertices, std::span<ui
 
 void GraphicsEngine::transition_image_layout(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout)
 {
-  auto aspect_mask = new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ?
+  auto barrier = get_image_layout_barrier({ image, old_layout, new_layout });
+  VkDependencyInfo dep_info
+  {
+    .sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers    = &barrier,
+  };
+
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+void GraphicsEngine::transition_image_layouts(VkCommandBuffer cmd, std::span<ImageLayoutTransition const> transitions,
+                                              std::pmr::memory_resource* arena)
+{
+  auto barriers = std::pmr::vector<VkImageMemoryBarrier2>(arena);
+  barriers.reserve(transitions.size());
+  for (auto const& transition : transitions)
+    barriers.emplace_back(get_image_layout_barrier(transition));
+
+  VkDependencyInfo dep_info
+  {
+    .sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .imageMemoryBarrierCount = (uint32_t)barriers.size(),
+    .pImageMemoryBarriers    = barriers.data(),
+  };
+
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+auto GraphicsEngine::get_image_layout_barrier(ImageLayoutTransition const& transition) -> VkImageMemoryBarrier2
+{
+  auto is_depth    = [](VkImageLayout layout)
+  {
+    return layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+           layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+  };
+  auto aspect_mask = is_depth(transition.old_layout) || is_depth(transition.new_layout) ?
                      VK_IMAGE_ASPECT_DEPTH_BIT :
                      VK_IMAGE_ASPECT_COLOR_BIT;
 
-  VkImageMemoryBarrier2 barrier
+  return
   {
     .sType            = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
     // HACK: use all commands bit will stall the GPU pipeline a bit, is inefficient.
@@ -203,19 +313,30 @@ void GraphicsEngine::transition_image_layout(VkCommandBuffer cmd, VkImage image,
     .dstStageMask     = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
     .dstAccessMask    = VK_ACCESS_2_MEMORY_READ_BIT  |
                         VK_ACCESS_2_MEMORY_WRITE_BIT,
-    .oldLayout        = old_layout,
-    .newLayout        = new_layout,
-    .image            = image,
+    .oldLayout        = transition.old_layout,
+    .newLayout        = transition.new_layout,
+    .image            = transition.image,
     .subresourceRange = get_image_subresource_range(aspect_mask),
   };
+}
 
+void GraphicsEngine::memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
+                                                     VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access)
+{
+  VkMemoryBarrier2 barrier
+  {
+    .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+    .srcStageMask  = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask  = dst_stage,
+    .dstAccessMask = dst_access,
+  };
   VkDependencyInfo dep_info
   {
-    .sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-    .imageMemoryBarrierCount = 1,
-    .pImageMemoryBarriers    = &barrier,
+    .sType              = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers    = &barrier,
   };
-
   vkCmdPipelineBarrier2(cmd, &dep_info);
 }
 
@@ -229,6 +350,12 @@ auto GraphicsEngine::get_image_subresource_range(VkImageAspectFlags aspect) -> V
   };
 }
 
+void GraphicsEngine::destroy_image(Image const& image)
+{
+  vkDestroyImageView(_device, image.view, nullptr);
+  vmaDestroyImage(_vma_allocator, image.image, image.allocation);
+}
+
 // HACK: VkCmdCopyImage can be faster but most restriction such as src and dst are same format and extent. 
 void GraphicsEngine::copy_image(VkCommandBuffer cmd, VkImage src, VkImage dst, VkExtent2D src_extent, VkExtent2D dst_extent)
 {
@@ -0,0 +1,132 @@
+#include "HeapGuard.hpp"
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef TK_ALLOCATION_TRACKING
+#include <malloc.h>
+#endif
+
+#ifdef TK_HEAP_GUARD
+
+namespace
+{
+  thread_local uint64_t Allocation_Count = 0;
+  thread_local uint32_t Allow_Depth      = 0;
+}
+
+namespace tk
+{
+  auto heap_allocation_count() noexcept -> uint64_t { return Allocation_Count; }
+
+  AllowHeapScope::AllowHeapScope() noexcept { ++Allow_Depth; }
+  AllowHeapScope::~AllowHeapScope()         { --Allow_Depth; }
+}
+
+#else
+
+namespace tk
+{
+  auto heap_allocation_count() noexcept -> uint64_t { return 0; }
+
+  AllowHeapScope::AllowHeapScope() noexcept {}
+  AllowHeapScope::~AllowHeapScope()         {}
+}
+
+#endif
+
+//
+// global new and delete are replaced in heap guard build to check hot paths,
+// and in tracking build to attribute allocations to scopes
+//
+#if defined(TK_HEAP_GUARD) || defined(TK_ALLOCATION_TRACKING)
+
+namespace
+{
+  template <typename Alloc>
+  void* allocate(Alloc&& alloc)
+  {
+#ifdef TK_HEAP_GUARD
+    if (Allow_Depth == 0)
+      ++Allocation_Count;
+#endif
+    while (true)
+    {
+      if (auto ptr = alloc())
+      {
+#ifdef TK_ALLOCATION_TRACKING
+        tk::allocation_tracker::on_cpu_allocate(malloc_usable_size(ptr));
+#endif
+        return ptr;
+      }
+      auto handler = std::get_new_handler();
+      if (!handler)
+        throw std::bad_alloc();
+      handler();
+    }
+  }
+
+  void* allocate(size_t size)
+  {
+    return allocate([=] { return std::malloc(size ? size : 1); });
+  }
+
+  void* allocate(size_t size, std::align_val_t alignment)
+  {
+    // size of aligned_alloc should be multiple of alignment
+    auto align = static_cast<size_t>(alignment);
+    size       = (std::max<size_t>(size, 1) + align - 1) / align * align;
+    return allocate([=] { return std::aligned_alloc(align, size); });
+  }
+
+  void deallocate(void* ptr) noexcept
+  {
+#ifdef TK_ALLOCATION_TRACKING
+    if (ptr)
+      tk::allocation_tracker::on_cpu_free(malloc_usable_size(ptr));
+#endif
+    std::free(ptr);
+  }
+}
+
+//
+// all forms are replaced, so they match each other when sanitizer also replaces them
+//
+void* operator new  (size_t size)                           { return allocate(size); }
+void* operator new[](size_t size)                           { return allocate(size); }
+void* operator new  (size_t size, std::align_val_t align)   { return allocate(size, align); }
+void* operator new[](size_t size, std::align_val_t align)   { return allocate(size, align); }
+
+void* operator new  (size_t size, std::nothrow_t const&) noexcept
+{
+  try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, std::nothrow_t const&) noexcept
+{
+  try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new  (size_t size, std::align_val_t align, std::nothrow_t const&) noexcept
+{
+  try { return allocate(size, align); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, std::align_val_t align, std::nothrow_t const&) noexcept
+{
+  try { return allocate(size, align); } catch (...) { return nullptr; }
+}
+
+void operator delete  (void* ptr) noexcept                                          { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept                                          { deallocate(ptr); }
+void operator delete  (void* ptr, size_t) noexcept                                  { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept                                  { deallocate(ptr); }
+void operator delete  (void* ptr, std::align_val_t) noexcept                        { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept                        { deallocate(ptr); }
+void operator delete  (void* ptr, size_t, std::align_val_t) noexcept                { deallocate(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept                { deallocate(ptr); }
+void operator delete  (void* ptr, std::nothrow_t const&) noexcept                   { deallocate(ptr); }
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept                   { deallocate(ptr); }
+void operator delete  (void* ptr, std::align_val_t, std::nothrow_t const&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, std::nothrow_t const&) noexcept { deallocate(ptr); }
+
+#endif
@@ -0,0 +1,35 @@
+//
+// shader pack tool
+//
+// usage: shader_pack <output> <spv files...>
+//
+// pack compiled shaders into one file which is loaded by graphics engine.
+//
+
+#include "ShaderPack.hpp"
+
+#include <print>
+#include <vector>
+
+using namespace tk::graphics_engine;
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::println(stderr, "usage: {} <output> <spv files...>", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    auto spv_files = std::vector<std::filesystem::path>(argv + 2, argv + argc);
+    write_shader_pack(argv[1], spv_files);
+  }
+  catch (std::exception const& e)
+  {
+    std::println(stderr, "{}", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}